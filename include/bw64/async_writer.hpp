@@ -0,0 +1,183 @@
+/**
+ * @file async_writer.hpp
+ *
+ * Writing samples from a real-time thread, with encoding and file I/O done by
+ * a background thread.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ring_buffer.hpp"
+#include "writer.hpp"
+
+namespace bw64 {
+
+  /**
+   * @brief Front end to a Bw64Writer for real-time threads
+   *
+   * Frames passed to write() are copied into a lock-free ring buffer, which
+   * is drained by a worker thread that encodes and writes them with the
+   * Bw64Writer. write() never blocks, allocates or makes system calls; if the
+   * ring buffer is full, the frames are dropped and counted in overruns().
+   *
+   * write() and close() must be called from the same thread. The Bw64Writer
+   * is used by the worker thread until close() returns, so any chunks must be
+   * set on it before it is passed in.
+   */
+  class Bw64AsyncWriter {
+   public:
+    /**
+     * @param writer       writer to write frames with
+     * @param bufferFrames capacity of the ring buffer in frames
+     * @param blockFrames  maximum number of frames written by the worker at
+     * once
+     * @param pollInterval how long the worker sleeps when there is nothing to
+     * write
+     */
+    Bw64AsyncWriter(std::unique_ptr<Bw64Writer> writer, uint64_t bufferFrames,
+                    uint64_t blockFrames = 4096,
+                    std::chrono::microseconds pollInterval =
+                        std::chrono::milliseconds(5))
+        : writer_(std::move(writer)),
+          channels_(writer_->channels()),
+          ring_(utils::safeCast<size_t>(bufferFrames * channels_)),
+          block_(utils::safeCast<size_t>(
+              (std::max)(blockFrames, uint64_t{1}) * channels_)),
+          pollInterval_(pollInterval) {
+      worker_ = std::thread(&Bw64AsyncWriter::run, this);
+    }
+
+    Bw64AsyncWriter(const Bw64AsyncWriter&) = delete;
+    Bw64AsyncWriter& operator=(const Bw64AsyncWriter&) = delete;
+
+    /// destructor; this will finalise and close the file if it has not
+    /// already been done, but it is recommended to call close() first to
+    /// handle exceptions
+    ~Bw64AsyncWriter() { close(); }
+
+    /**
+     * @brief Queue interleaved frames to be written
+     *
+     * This is safe to call from a real-time thread.
+     *
+     * @param inBuffer buffer to read samples from
+     * @param frames   number of frames to write
+     *
+     * @returns true if the frames were queued, or false if there was not
+     * enough space in the ring buffer for all of them, in which case none
+     * are written
+     */
+    bool write(const float* inBuffer, uint64_t frames) {
+      const uint64_t samples = frames * channels_;
+      if (samples > ring_.writeAvailable()) {
+        overruns_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      ring_.write(inBuffer, static_cast<size_t>(samples));
+      return true;
+    }
+
+    /**
+     * @brief Write the remaining frames, stop the worker and close the file
+     *
+     * This may wait for up to the poll interval for the worker to wake up.
+     *
+     * @throws std::runtime_error or any other error from the Bw64Writer,
+     * including those raised on the worker thread
+     */
+    void close() {
+      if (!worker_.joinable()) return;
+      stop_.store(true, std::memory_order_release);
+      worker_.join();
+
+      if (error_) {
+        // the original error is more useful than any from closing
+        try {
+          writer_->close();
+        } catch (...) {
+        }
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+      }
+      writer_->close();
+    }
+
+    /// @brief Get number of channels
+    uint16_t channels() const { return channels_; }
+    /// @brief Get the capacity of the ring buffer in frames
+    uint64_t bufferFrames() const { return ring_.capacity() / channels_; }
+    /// @brief Get the number of frames written to the file by the worker
+    uint64_t framesWritten() const {
+      return framesWritten_.load(std::memory_order_relaxed);
+    }
+    /// @brief Get the number of write() calls which dropped their frames
+    /// because the ring buffer was full
+    uint64_t overruns() const {
+      return overruns_.load(std::memory_order_relaxed);
+    }
+    /// @brief Get the number of times the ring buffer ran empty after frames
+    /// had been queued, so the worker went from writing to waiting
+    ///
+    /// Polls while waiting for the first frames, or while still waiting
+    /// after running empty, are not counted.
+    uint64_t underruns() const {
+      return underruns_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    void run() {
+      // did the last poll find frames to write?
+      bool writing = false;
+      try {
+        while (true) {
+          // checked before reading, so that everything written before close()
+          // is drained
+          const bool stop = stop_.load(std::memory_order_acquire);
+          const size_t samples = ring_.read(block_.data(), block_.size());
+          if (samples) {
+            const uint64_t frames = samples / channels_;
+            writer_->write(block_.data(), frames);
+            framesWritten_.fetch_add(frames, std::memory_order_relaxed);
+            writing = true;
+          } else if (stop) {
+            return;
+          } else {
+            if (writing) underruns_.fetch_add(1, std::memory_order_relaxed);
+            writing = false;
+            std::this_thread::sleep_for(pollInterval_);
+          }
+        }
+      } catch (...) {
+        // stop writing; further frames fill the ring buffer and are counted
+        // as overruns
+        error_ = std::current_exception();
+      }
+    }
+
+    std::unique_ptr<Bw64Writer> writer_;
+    uint16_t channels_;
+    utils::RingBuffer<float> ring_;
+    /// frames taken from ring_ by the worker, to be written
+    std::vector<float> block_;
+    std::chrono::microseconds pollInterval_;
+
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> framesWritten_{0};
+    std::atomic<uint64_t> overruns_{0};
+    std::atomic<uint64_t> underruns_{0};
+    /// set by the worker before it exits; read after joining it
+    std::exception_ptr error_;
+
+    std::thread worker_;
+  };
+
+}  // namespace bw64
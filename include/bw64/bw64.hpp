@@ -5,6 +5,9 @@
  * into your user code.
  */
 #pragma once
+#include "async_writer.hpp"
+#include "player.hpp"
+#include "probe.hpp"
 #include "reader.hpp"
 #include "writer.hpp"
 
@@ -14,14 +17,16 @@ namespace bw64 {
    * @brief Open a BW64 file for reading
    *
    * @param filename path of the file to read
+   * @param mode how to access the file, see ReadMode
    *
    * Convenience function to open a BW64 file for reading.
    *
    * @returns `unique_ptr` to a Bw64Reader instance that is ready to read
    * samples.
    */
-  inline std::unique_ptr<Bw64Reader> readFile(const std::string& filename) {
-    return std::unique_ptr<Bw64Reader>(new Bw64Reader(filename.c_str()));
+  inline std::unique_ptr<Bw64Reader> readFile(
+      const std::string& filename, ReadMode mode = ReadMode::stream) {
+    return std::unique_ptr<Bw64Reader>(new Bw64Reader(filename.c_str(), mode));
   }
 
   /**
@@ -40,6 +45,7 @@ namespace bw64 {
    * @param bitDepth target bitdepth of the new file
    * @param chnaChunk Channel allocation chunk to include, if any
    * @param axmlChunk AXML chunk to include, if any
+   * @param mode how to write sample data, see WriteMode
    *
    * @returns `unique_ptr` to a Bw64Writer instance that is ready to write
    * samples.
@@ -49,7 +55,8 @@ namespace bw64 {
       const std::string& filename, uint16_t channels = 1u,
       uint32_t sampleRate = 48000u, uint16_t bitDepth = 24u,
       std::shared_ptr<ChnaChunk> chnaChunk = nullptr,
-      std::shared_ptr<AxmlChunk> axmlChunk = nullptr) {
+      std::shared_ptr<AxmlChunk> axmlChunk = nullptr,
+      WriteMode mode = WriteMode::stream) {
     std::vector<std::shared_ptr<Chunk>> additionalChunks;
     if (chnaChunk) {
       additionalChunks.push_back(chnaChunk);
@@ -57,8 +64,9 @@ namespace bw64 {
     if (axmlChunk) {
       additionalChunks.push_back(axmlChunk);
     }
-    return std::unique_ptr<Bw64Writer>(new Bw64Writer(
-        filename.c_str(), channels, sampleRate, bitDepth, additionalChunks));
+    return std::unique_ptr<Bw64Writer>(
+        new Bw64Writer(filename.c_str(), channels, sampleRate, bitDepth,
+                       additionalChunks, mode));
   }
 
 }  // namespace bw64
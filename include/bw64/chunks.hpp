@@ -67,8 +67,8 @@ namespace bw64 {
     uint64_t size() const override { return data_.size(); }
 
     void write(std::ostream& stream) const override {
-      std::copy(data_.begin(), data_.end(),
-                std::ostreambuf_iterator<char>(stream));
+      if (!data_.empty())
+        stream.write(data_.data(), static_cast<std::streamsize>(data_.size()));
     }
 
    private:
@@ -241,8 +241,8 @@ namespace bw64 {
     uint64_t size() const override { return data_.size(); }
 
     void write(std::ostream& stream) const override {
-      std::copy(data_.begin(), data_.end(),
-                std::ostreambuf_iterator<char>(stream));
+      if (!data_.empty())
+        stream.write(data_.data(), static_cast<std::streamsize>(data_.size()));
     }
 
    private:
@@ -343,11 +343,14 @@ namespace bw64 {
         throw std::runtime_error(
             "AudioId trackIndex is 1-based, so must not be zero");
 
-      utils::writeValue(stream, trackIndex());
-      utils::writeValue(stream, uid_);
-      utils::writeValue(stream, trackRef_);
-      utils::writeValue(stream, packRef_);
-      utils::writeValue(stream, ' ');  // padding
+      // packed into one record, so that it is written with one call
+      char record[40];
+      std::memcpy(record, &trackIndex_, 2);
+      std::memcpy(record + 2, uid_, 12);
+      std::memcpy(record + 14, trackRef_, 14);
+      std::memcpy(record + 28, packRef_, 11);
+      record[39] = ' ';  // padding
+      stream.write(record, sizeof(record));
     }
 
     bool operator==(const AudioId& rhs) const {
@@ -397,7 +400,7 @@ namespace bw64 {
     void write(std::ostream& stream) const override {
       utils::writeValue(stream, numTracks());
       utils::writeValue(stream, numUids());
-      for (auto audioId : audioIds()) {
+      for (auto& audioId : audioIds()) {
         audioId.write(stream);
       }
     }
@@ -0,0 +1,527 @@
+/**
+ * @file io.hpp
+ *
+ * Thin wrappers around the native file APIs, for the I/O modes which can not
+ * be implemented on top of the standard library streams.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <ios>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bw64 {
+  namespace utils {
+
+    /// @brief Throw a runtime_error for a file which could not be opened
+    inline void throwCouldNotOpen(const char* filename) {
+      std::stringstream errorString;
+      errorString << "Could not open file: " << filename;
+      throw std::runtime_error(errorString.str());
+    }
+
+    /// @brief How a File is opened
+    enum class FileAccess {
+      /// open for reading
+      read,
+      /// open an existing file for writing, without truncating it
+      write
+    };
+
+    /// @brief Alignment of file offsets, sizes and buffers for direct I/O
+    ///
+    /// This is a multiple of the logical block size of all common devices.
+    const uint64_t directIoAlignment = 4096;
+
+    /// @brief Round value up to a multiple of directIoAlignment
+    inline uint64_t alignUp(uint64_t value) {
+      return (value + directIoAlignment - 1) / directIoAlignment *
+             directIoAlignment;
+    }
+
+    /// @brief Round value down to a multiple of directIoAlignment
+    inline uint64_t alignDown(uint64_t value) {
+      return value / directIoAlignment * directIoAlignment;
+    }
+
+    /**
+     * @brief Native file handle
+     *
+     * The handle is closed on destruction.
+     */
+    class File {
+     public:
+      File() = default;
+      explicit File(const char* filename,
+                    FileAccess access = FileAccess::read,
+                    bool direct = false) {
+        open(filename, access, direct);
+      }
+      File(const File&) = delete;
+      File& operator=(const File&) = delete;
+      ~File() { close(); }
+
+      /**
+       * @brief Open a file; throws if this fails
+       *
+       * @param filename file to open
+       * @param access   whether to read or write
+       * @param direct   try to bypass the page cache, with O_DIRECT on Linux,
+       * F_NOCACHE on macOS and FILE_FLAG_NO_BUFFERING on Windows. If this is
+       * not supported (e.g. by the file system), the file is opened normally;
+       * see isDirect(). Some file systems accept O_DIRECT here but reject
+       * reads or writes with EINVAL; O_DIRECT is then turned off and the
+       * request is tried again. For direct files, offsets, sizes and buffers
+       * of all reads and writes should be multiples of directIoAlignment.
+       */
+      void open(const char* filename, FileAccess access = FileAccess::read,
+                bool direct = false) {
+        close();
+#ifdef _WIN32
+        const DWORD flags = direct ? FILE_FLAG_NO_BUFFERING
+                                   : FILE_ATTRIBUTE_NORMAL;
+        if (access == FileAccess::read)
+          handle_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+                                nullptr, OPEN_EXISTING, flags, nullptr);
+        else
+          handle_ = CreateFileA(filename, GENERIC_WRITE,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                OPEN_EXISTING, flags, nullptr);
+        direct_ = direct;
+#else
+        const int flags = access == FileAccess::read ? O_RDONLY : O_WRONLY;
+#ifdef O_DIRECT
+        if (direct) {
+          fd_ = ::open(filename, flags | O_DIRECT);
+          direct_ = fd_ != -1;
+          openedDirect_ = fd_ != -1;
+          // not supported by this file system
+          if (fd_ == -1 && errno == EINVAL) fd_ = ::open(filename, flags);
+        } else {
+          fd_ = ::open(filename, flags);
+        }
+#else
+        fd_ = ::open(filename, flags);
+#ifdef F_NOCACHE
+        if (direct && fd_ != -1) direct_ = ::fcntl(fd_, F_NOCACHE, 1) == 0;
+#endif
+#endif
+#endif
+        if (!isOpen()) throwCouldNotOpen(filename);
+      }
+
+      /// @brief Does this file bypass the page cache?
+      bool isDirect() const { return direct_; }
+
+      /// @brief Close the file, if it is open
+      void close() {
+        if (!isOpen()) return;
+#ifdef _WIN32
+        CloseHandle(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+#else
+        ::close(fd_);
+        fd_ = -1;
+#endif
+        direct_ = false;
+        openedDirect_ = false;
+      }
+
+#ifdef _WIN32
+      bool isOpen() const { return handle_ != INVALID_HANDLE_VALUE; }
+      /// @brief Get the native handle
+      HANDLE handle() const { return handle_; }
+#else
+      bool isOpen() const { return fd_ != -1; }
+      /// @brief Get the native file descriptor
+      int fd() const { return fd_; }
+#endif
+
+      /// @brief Get the size of the file in bytes
+      uint64_t size() const {
+#ifdef _WIN32
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(handle_, &fileSize))
+          throw std::runtime_error("could not determine file size");
+        return static_cast<uint64_t>(fileSize.QuadPart);
+#else
+        struct stat info;
+        if (fstat(fd_, &info) != 0)
+          throw std::runtime_error("could not determine file size");
+        return static_cast<uint64_t>(info.st_size);
+#endif
+      }
+
+      /**
+       * @brief Read bytes from a given position in the file
+       *
+       * This does not use or change a file position, so may be called from
+       * several threads at once.
+       *
+       * @returns number of bytes read, which is less than size only if the
+       * end of the file is reached
+       */
+      uint64_t readAt(char* buffer, uint64_t size, uint64_t offset) const {
+        // limit the size of each request to fit the native size types
+        const uint64_t maxRequest = uint64_t{1} << 30;
+        uint64_t done = 0;
+#ifndef _WIN32
+        bool retried = false;
+#endif
+        while (done < size) {
+          const uint64_t request = (std::min)(size - done, maxRequest);
+          const uint64_t position = offset + done;
+#ifdef _WIN32
+          OVERLAPPED overlapped = {};
+          overlapped.Offset = static_cast<DWORD>(position);
+          overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+          DWORD count = 0;
+          if (!ReadFile(handle_, buffer + done, static_cast<DWORD>(request),
+                        &count, &overlapped)) {
+            if (GetLastError() == ERROR_HANDLE_EOF) break;
+            throw std::runtime_error("file error while reading");
+          }
+#else
+          const ssize_t count =
+              ::pread(fd_, buffer + done, static_cast<size_t>(request),
+                      static_cast<off_t>(position));
+          if (count < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && !retried && disableDirect()) {
+              retried = true;
+              continue;
+            }
+            throw std::runtime_error("file error while reading");
+          }
+#endif
+          if (count == 0) break;
+          done += static_cast<uint64_t>(count);
+        }
+        return done;
+      }
+
+      /// @brief Write bytes to a given position in the file; throws if they
+      /// can not all be written
+      void writeAt(const char* buffer, uint64_t size, uint64_t offset) {
+        // limit the size of each request to fit the native size types
+        const uint64_t maxRequest = uint64_t{1} << 30;
+        uint64_t done = 0;
+#ifndef _WIN32
+        bool retried = false;
+#endif
+        while (done < size) {
+          const uint64_t request = (std::min)(size - done, maxRequest);
+          const uint64_t position = offset + done;
+#ifdef _WIN32
+          OVERLAPPED overlapped = {};
+          overlapped.Offset = static_cast<DWORD>(position);
+          overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+          DWORD count = 0;
+          if (!WriteFile(handle_, buffer + done, static_cast<DWORD>(request),
+                         &count, &overlapped))
+            throw std::runtime_error("file error while writing");
+#else
+          const ssize_t count =
+              ::pwrite(fd_, buffer + done, static_cast<size_t>(request),
+                       static_cast<off_t>(position));
+          if (count < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && !retried && disableDirect()) {
+              retried = true;
+              continue;
+            }
+            throw std::runtime_error("file error while writing");
+          }
+#endif
+          if (count == 0) throw std::runtime_error("file error while writing");
+          done += static_cast<uint64_t>(count);
+        }
+      }
+
+      /**
+       * @brief Reserve storage for the first size bytes of the file, without
+       * changing the file size
+       *
+       * This uses `fallocate()` with `FALLOC_FL_KEEP_SIZE` on Linux,
+       * `F_PREALLOCATE` on macOS, and `FileAllocationInfo` on Windows.
+       *
+       * @returns true if the storage was reserved, or false if this is not
+       * supported by the platform or file system
+       */
+      bool allocate(uint64_t size) {
+        const uint64_t current = this->size();
+        if (size <= current) return true;
+#ifdef _WIN32
+        FILE_ALLOCATION_INFO allocation;
+        allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+        return SetFileInformationByHandle(handle_, FileAllocationInfo,
+                                          &allocation, sizeof(allocation)) != 0;
+#elif defined(FALLOC_FL_KEEP_SIZE)
+        int result;
+        do {
+          result = ::fallocate(fd_, FALLOC_FL_KEEP_SIZE,
+                               static_cast<off_t>(current),
+                               static_cast<off_t>(size - current));
+        } while (result != 0 && errno == EINTR);
+        return result == 0;
+#elif defined(F_PREALLOCATE)
+        // try for contiguous storage first
+        fstore_t store = {};
+        store.fst_flags = F_ALLOCATECONTIG | F_ALLOCATEALL;
+        store.fst_posmode = F_PEOFPOSMODE;
+        store.fst_offset = 0;
+        store.fst_length = static_cast<off_t>(size - current);
+        if (::fcntl(fd_, F_PREALLOCATE, &store) != -1) return true;
+        store.fst_flags = F_ALLOCATEALL;
+        return ::fcntl(fd_, F_PREALLOCATE, &store) != -1;
+#else
+        return false;
+#endif
+      }
+
+      /// @brief Set the size of the file, releasing any storage reserved by
+      /// allocate() after the end
+      void truncate(uint64_t size) {
+#ifdef _WIN32
+        FILE_END_OF_FILE_INFO endOfFile;
+        endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+        FILE_ALLOCATION_INFO allocation;
+        allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFileInformationByHandle(handle_, FileEndOfFileInfo, &endOfFile,
+                                        sizeof(endOfFile)) ||
+            !SetFileInformationByHandle(handle_, FileAllocationInfo,
+                                        &allocation, sizeof(allocation)))
+          throw std::runtime_error("file error while truncating");
+#else
+        int result;
+        do {
+          result = ::ftruncate(fd_, static_cast<off_t>(size));
+        } while (result != 0 && errno == EINTR);
+        if (result != 0)
+          throw std::runtime_error("file error while truncating");
+#endif
+      }
+
+     private:
+      /// after a read or write failed with EINVAL, turn off O_DIRECT if the
+      /// file was opened with it; returns true if the request should be
+      /// tried again
+      ///
+      /// This changes only the flags of the open file, so is safe to call
+      /// from several threads at once.
+      bool disableDirect() const {
+#if defined(O_DIRECT) && !defined(_WIN32)
+        if (!openedDirect_) return false;
+        const int flags = ::fcntl(fd_, F_GETFL);
+        if (flags == -1) return false;
+        if ((flags & O_DIRECT) && ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT) != 0)
+          return false;
+        direct_ = false;
+        return true;
+#else
+        return false;
+#endif
+      }
+
+#ifdef _WIN32
+      HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+      int fd_ = -1;
+#endif
+      // direct_ may be cleared by disableDirect() from several threads
+      mutable std::atomic<bool> direct_{false};
+      bool openedDirect_ = false;
+    };
+
+    /**
+     * @brief Buffer whose data is aligned to directIoAlignment
+     *
+     * The contents are not preserved when resizing.
+     */
+    class AlignedBuffer {
+     public:
+      AlignedBuffer() = default;
+      AlignedBuffer(const AlignedBuffer&) = delete;
+      AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+      /// @brief Make the buffer hold at least size bytes
+      void resize(uint64_t size) {
+        if (size <= size_) return;
+        storage_.clear();
+        storage_.resize(static_cast<size_t>(size + directIoAlignment));
+        const uintptr_t address = reinterpret_cast<uintptr_t>(&storage_[0]);
+        data_ = &storage_[0] + (alignUp(address) - address);
+        size_ = size;
+      }
+
+      /// @brief Free the memory held by the buffer
+      void clear() {
+        std::vector<char>().swap(storage_);
+        data_ = nullptr;
+        size_ = 0;
+      }
+
+      char* data() { return data_; }
+      const char* data() const { return data_; }
+      uint64_t size() const { return size_; }
+
+     private:
+      std::vector<char> storage_;
+      char* data_ = nullptr;
+      uint64_t size_ = 0;
+    };
+
+    /**
+     * @brief Read a range of a file through an AlignedBuffer
+     *
+     * The aligned range around [offset, offset + size) is read into buffer,
+     * so this works for files opened for direct I/O.
+     *
+     * @returns pointer to the byte at offset in buffer
+     *
+     * @throws std::runtime_error if the file ends before offset + size
+     */
+    inline const char* readAligned(const File& file, AlignedBuffer& buffer,
+                                   uint64_t offset, uint64_t size) {
+      const uint64_t start = alignDown(offset);
+      const uint64_t end = alignUp(offset + size);
+      buffer.resize(end - start);
+      // the file may end before end; only the requested part must be read
+      const uint64_t read = file.readAt(buffer.data(), end - start, start);
+      if (read < offset + size - start)
+        throw std::runtime_error("file ended while reading frames");
+      return buffer.data() + (offset - start);
+    }
+
+    /**
+     * @brief Read-only memory mapping of a whole file
+     *
+     * The mapping is released on destruction.
+     */
+    class MappedFile {
+     public:
+      MappedFile() = default;
+      explicit MappedFile(const char* filename) { open(filename); }
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+      ~MappedFile() { close(); }
+
+      /// @brief Map a file; throws if it can not be opened or mapped
+      void open(const char* filename) {
+        close();
+        File file(filename);
+        const uint64_t fileSize = file.size();
+        if (fileSize > (std::numeric_limits<size_t>::max)())
+          throw std::runtime_error("file is too large to be mapped");
+
+        // empty files can not be mapped; they are represented by a null
+        // pointer with a size of zero
+        if (fileSize) {
+#ifdef _WIN32
+          HANDLE mapping = CreateFileMappingA(file.handle(), nullptr,
+                                              PAGE_READONLY, 0, 0, nullptr);
+          if (!mapping) throw std::runtime_error("could not map file");
+          void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+          // the view keeps a reference to the mapping object
+          CloseHandle(mapping);
+          if (!data) throw std::runtime_error("could not map file");
+#else
+          void* data = ::mmap(nullptr, static_cast<size_t>(fileSize),
+                              PROT_READ, MAP_SHARED, file.fd(), 0);
+          if (data == MAP_FAILED)
+            throw std::runtime_error("could not map file");
+#endif
+          data_ = static_cast<const char*>(data);
+        }
+        size_ = fileSize;
+        open_ = true;
+      }
+
+      /// @brief Release the mapping, if there is one
+      void close() {
+        if (data_) {
+#ifdef _WIN32
+          UnmapViewOfFile(data_);
+#else
+          ::munmap(const_cast<char*>(data_), static_cast<size_t>(size_));
+#endif
+        }
+        data_ = nullptr;
+        size_ = 0;
+        open_ = false;
+      }
+
+      bool isOpen() const { return open_; }
+      /// @brief Pointer to the first byte of the file
+      const char* data() const { return data_; }
+      /// @brief Size of the mapped file in bytes
+      uint64_t size() const { return size_; }
+
+     private:
+      const char* data_ = nullptr;
+      uint64_t size_ = 0;
+      bool open_ = false;
+    };
+
+    /**
+     * @brief Seekable read-only stream buffer over a block of memory
+     *
+     * This allows the stream based parser functions to work directly on a
+     * MappedFile without copying it.
+     */
+    class MemoryStreamBuf : public std::streambuf {
+     public:
+      MemoryStreamBuf(const char* data = nullptr, uint64_t size = 0) {
+        setBuffer(data, size);
+      }
+
+      /// @brief Set the memory to read from, and rewind to the start
+      void setBuffer(const char* data, uint64_t size) {
+        // the get area is never written to through these pointers
+        char* begin = const_cast<char*>(data);
+        setg(begin, begin, begin + size);
+      }
+
+     protected:
+      pos_type seekoff(off_type offset, std::ios_base::seekdir way,
+                       std::ios_base::openmode which) override {
+        if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+
+        off_type start = 0;
+        if (way == std::ios_base::cur)
+          start = gptr() - eback();
+        else if (way == std::ios_base::end)
+          start = egptr() - eback();
+
+        const off_type position = start + offset;
+        if (position < 0 || position > egptr() - eback())
+          return pos_type(off_type(-1));
+
+        setg(eback(), eback() + position, egptr());
+        return pos_type(position);
+      }
+
+      pos_type seekpos(pos_type position,
+                       std::ios_base::openmode which) override {
+        return seekoff(off_type(position), std::ios_base::beg, which);
+      }
+    };
+
+  }  // namespace utils
+}  // namespace bw64
@@ -0,0 +1,357 @@
+/**
+ * @file io_uring.hpp
+ *
+ * Minimal io_uring wrapper for block reads and writes of sample data, used
+ * when built with `BW64_WITH_IO_URING` on Linux.
+ *
+ * This talks to the kernel directly through the io_uring system calls, so
+ * does not need liburing. If the kernel does not support io_uring, or the
+ * operations used here, IoUring::isOpen() returns false, and the normal
+ * stream I/O is used instead.
+ */
+#pragma once
+#if defined(BW64_WITH_IO_URING) && defined(__linux__)
+#define BW64_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+// linux/io_uring.h includes linux/fs.h, which defines BLOCK_SIZE; this is
+// likely to clash with names in user code, so is removed again
+#ifndef BLOCK_SIZE
+#define BW64_UNDEF_BLOCK_SIZE
+#endif
+#include <linux/io_uring.h>
+#ifdef BW64_UNDEF_BLOCK_SIZE
+#undef BLOCK_SIZE
+#undef BLOCK_SIZE_BITS
+#undef BW64_UNDEF_BLOCK_SIZE
+#endif
+
+namespace bw64 {
+  namespace utils {
+
+    /**
+     * @brief An io_uring instance which keeps several block reads or writes
+     * in flight
+     *
+     * One buffer may be registered with useBuffer(); transfers to or from
+     * inside this use the fixed-buffer operations, which avoids mapping the
+     * pages for every request.
+     *
+     * If an error is thrown while requests are in flight, they are waited
+     * for first, so the buffer is no longer in use by the kernel; if even
+     * that fails, the ring is closed, and later transfers throw.
+     *
+     * This is not thread-safe.
+     */
+    class IoUring {
+     public:
+      /**
+       * @param entries   maximum number of requests in flight
+       * @param blockSize maximum size of each request in bytes
+       */
+      explicit IoUring(unsigned entries = 8, uint32_t blockSize = 1u << 18)
+          : blockSize_(blockSize) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        const long fd = ::syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0) return;
+        fd_ = static_cast<int>(fd);
+
+        // only support kernels which map both rings at once (5.4+) and
+        // support IORING_OP_READ and IORING_OP_WRITE (5.6+)
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !mapRings(params) ||
+            !supportsOps()) {
+          close();
+          return;
+        }
+        entries_ = params.sq_entries;
+      }
+
+      IoUring(const IoUring&) = delete;
+      IoUring& operator=(const IoUring&) = delete;
+      ~IoUring() { close(); }
+
+      /// @brief Could io_uring be set up?
+      bool isOpen() const { return fd_ != -1; }
+
+      /**
+       * @brief Register a buffer to use fixed-buffer operations for
+       *
+       * Nothing is done if this buffer (or a larger one at the same address)
+       * is already registered. If registration fails (for example because of
+       * RLIMIT_MEMLOCK), normal operations are used for all buffers.
+       */
+      void useBuffer(char* data, size_t size) {
+        if (!canRegister_ || size == 0) return;
+        if (data == registered_.iov_base && size <= registered_.iov_len)
+          return;
+
+        unregisterBuffer();
+        iovec buffer;
+        buffer.iov_base = data;
+        buffer.iov_len = size;
+        if (register_(IORING_REGISTER_BUFFERS, &buffer, 1) == 0)
+          registered_ = buffer;
+        else
+          canRegister_ = false;
+      }
+
+      /// @brief Forget about the buffer registered with useBuffer(); this
+      /// must be called before the buffer is freed
+      void unregisterBuffer() {
+        if (!registered_.iov_base) return;
+        register_(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        registered_.iov_base = nullptr;
+        registered_.iov_len = 0;
+      }
+
+      /**
+       * @brief Read bytes from a position in a file
+       *
+       * @returns number of bytes read, which is less than size only if the
+       * end of the file is reached
+       */
+      uint64_t readAt(int fd, char* buffer, uint64_t size, uint64_t offset) {
+        return transfer(false, fd, buffer, size, offset);
+      }
+
+      /// @brief Write bytes to a position in a file; throws if not all bytes
+      /// can be written
+      void writeAt(int fd, const char* buffer, uint64_t size,
+                   uint64_t offset) {
+        // the buffer is only read from
+        if (transfer(true, fd, const_cast<char*>(buffer), size, offset) !=
+            size)
+          throw std::runtime_error("file error while writing");
+      }
+
+     private:
+      bool mapRings(const io_uring_params& params) {
+        ringSize_ = (std::max)(
+            params.sq_off.array + params.sq_entries * sizeof(unsigned),
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        void* ring = ::mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (ring == MAP_FAILED) return false;
+        ring_ = static_cast<char*>(ring);
+
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+        sqTail_ = reinterpret_cast<unsigned*>(ring_ + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned*>(ring_ + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned*>(ring_ + params.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned*>(ring_ + params.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned*>(ring_ + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned*>(ring_ + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(ring_ + params.cq_off.cqes);
+        return true;
+      }
+
+      bool supportsOps() {
+        const size_t probeSize =
+            sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::vector<char> probeData(probeSize, 0);
+        io_uring_probe* probe =
+            reinterpret_cast<io_uring_probe*>(probeData.data());
+        if (register_(IORING_REGISTER_PROBE, probe, 256) != 0) return false;
+
+        for (int op : {IORING_OP_READ, IORING_OP_WRITE}) {
+          if (op > probe->last_op ||
+              !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            return false;
+        }
+        return true;
+      }
+
+      void close() {
+        unregisterBuffer();
+        if (sqes_) ::munmap(sqes_, sqesSize_);
+        if (ring_) ::munmap(ring_, ringSize_);
+        if (fd_ != -1) ::close(fd_);
+        sqes_ = nullptr;
+        ring_ = nullptr;
+        fd_ = -1;
+        toSubmit_ = 0;
+      }
+
+      int register_(unsigned opcode, void* arg, unsigned nrArgs) {
+        return static_cast<int>(
+            ::syscall(__NR_io_uring_register, fd_, opcode, arg, nrArgs));
+      }
+
+      /// queue one request; there must be space in the submission queue
+      void prepare(bool write, int fd, char* data, uint32_t size,
+                   uint64_t offset, uint64_t userData) {
+        const unsigned tail = *sqTail_;
+        const unsigned index = tail & sqMask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+
+        const char* registered = static_cast<char*>(registered_.iov_base);
+        const bool fixed = registered && data >= registered &&
+                           data + size <= registered + registered_.iov_len;
+        if (fixed)
+          sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        else
+          sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = size;
+        sqe->off = offset;
+        sqe->buf_index = 0;
+        sqe->user_data = userData;
+
+        sqArray_[index] = index;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        toSubmit_++;
+      }
+
+      /// submit queued requests, and wait for at least one completion
+      void submitAndWait() {
+        while (true) {
+          const long submitted =
+              ::syscall(__NR_io_uring_enter, fd_, toSubmit_, 1u,
+                        IORING_ENTER_GETEVENTS, nullptr, 0);
+          if (submitted >= 0) {
+            toSubmit_ -= static_cast<unsigned>(submitted);
+            return;
+          }
+          if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            throw std::runtime_error("io_uring_enter failed");
+        }
+      }
+
+      /// take one completion, if there is one
+      bool popCompletion(io_uring_cqe& cqe) {
+        const unsigned head = *cqHead_;
+        if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) return false;
+        cqe = cqes_[head & cqMask_];
+        __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+
+      /// wait for inFlight requests (submitted or not) to complete, ignoring
+      /// the results; if this is not possible, the ring is closed instead
+      void drain(unsigned inFlight) {
+        io_uring_cqe cqe;
+        while (true) {
+          while (inFlight && popCompletion(cqe)) inFlight--;
+          if (!inFlight) return;
+
+          const long submitted =
+              ::syscall(__NR_io_uring_enter, fd_, toSubmit_, 1u,
+                        IORING_ENTER_GETEVENTS, nullptr, 0);
+          if (submitted >= 0) {
+            toSubmit_ -= static_cast<unsigned>(submitted);
+          } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            close();
+            return;
+          }
+        }
+      }
+
+      /// read or write [offset, offset + size) in blocks of up to blockSize_,
+      /// with up to entries_ in flight, retrying short transfers
+      uint64_t transfer(bool write, int fd, char* buffer, uint64_t size,
+                        uint64_t offset) {
+        if (!isOpen())
+          throw std::runtime_error(write ? "file error while writing"
+                                         : "file error while reading");
+        const uint64_t numBlocks = (size + blockSize_ - 1) / blockSize_;
+        // bytes transferred so far for each block
+        std::vector<uint32_t> done(numBlocks, 0);
+        uint64_t nextBlock = 0;
+        unsigned inFlight = 0;
+        // the end of the data if the end of the file is reached on a read
+        uint64_t end = size;
+        bool failed = false;
+
+        auto submit = [&](uint64_t block) {
+          const uint64_t start = block * blockSize_ + done[block];
+          const uint64_t blockEnd = (std::min)((block + 1) * blockSize_, size);
+          prepare(write, fd, buffer + start,
+                  static_cast<uint32_t>(blockEnd - start), offset + start,
+                  block);
+          inFlight++;
+        };
+
+        while (true) {
+          while (!failed && inFlight < entries_ && nextBlock < numBlocks &&
+                 nextBlock * blockSize_ < end)
+            submit(nextBlock++);
+          if (!inFlight) break;
+
+          try {
+            submitAndWait();
+          } catch (...) {
+            // the kernel may still be using buffer, which the caller is free
+            // to release once this returns
+            drain(inFlight);
+            throw;
+          }
+          io_uring_cqe cqe;
+          while (popCompletion(cqe)) {
+            inFlight--;
+            const uint64_t block = cqe.user_data;
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+              if (!failed) submit(block);
+            } else if (cqe.res < 0 || (cqe.res == 0 && write)) {
+              failed = true;
+            } else if (cqe.res == 0) {
+              end = (std::min)(end, block * blockSize_ + done[block]);
+            } else {
+              done[block] += static_cast<uint32_t>(cqe.res);
+              const uint64_t blockEnd =
+                  (std::min)((block + 1) * blockSize_, size);
+              // short transfer; continue from where it stopped
+              if (block * blockSize_ + done[block] < blockEnd && !failed)
+                submit(block);
+            }
+          }
+        }
+
+        if (failed)
+          throw std::runtime_error(write ? "file error while writing"
+                                         : "file error while reading");
+        return end;
+      }
+
+      int fd_ = -1;
+      unsigned entries_ = 0;
+      uint32_t blockSize_;
+      unsigned toSubmit_ = 0;
+
+      char* ring_ = nullptr;
+      size_t ringSize_ = 0;
+      io_uring_sqe* sqes_ = nullptr;
+      size_t sqesSize_ = 0;
+      unsigned* sqTail_ = nullptr;
+      unsigned sqMask_ = 0;
+      unsigned* sqArray_ = nullptr;
+      unsigned* cqHead_ = nullptr;
+      unsigned* cqTail_ = nullptr;
+      unsigned cqMask_ = 0;
+      io_uring_cqe* cqes_ = nullptr;
+
+      iovec registered_ = {nullptr, 0};
+      bool canRegister_ = true;
+    };
+
+  }  // namespace utils
+}  // namespace bw64
+
+#endif
@@ -0,0 +1,236 @@
+/**
+ * @file player.hpp
+ *
+ * Playing samples to a real-time thread, with file I/O and decoding done by
+ * a background thread.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "reader.hpp"
+#include "ring_buffer.hpp"
+
+namespace bw64 {
+
+  /**
+   * @brief Front end to a Bw64Reader for real-time threads
+   *
+   * A worker thread decodes frames ahead of the play position into a
+   * lock-free ring buffer, from which pull() copies them without blocking,
+   * allocating or making system calls. If not enough frames have been
+   * decoded, the rest of the output is filled with silence, and this is
+   * counted in underruns().
+   *
+   * seek() discards the decoded frames and makes the worker refill the ring
+   * buffer from the new position; until it has, pull() outputs silence.
+   *
+   * pull(), seek(), tell() and bufferedFrames() must be called from the same
+   * thread. The Bw64Reader is used by the worker thread with
+   * Bw64Reader::readAt() until close() returns, so any other use of it must
+   * also be thread-safe.
+   */
+  class Bw64Player {
+   public:
+    /**
+     * @param reader       reader to read frames with
+     * @param bufferFrames capacity of the ring buffer in frames
+     * @param blockFrames  maximum number of frames decoded by the worker at
+     * once
+     * @param pollInterval how long the worker sleeps when the ring buffer is
+     * full
+     */
+    Bw64Player(std::unique_ptr<Bw64Reader> reader, uint64_t bufferFrames,
+               uint64_t blockFrames = 4096,
+               std::chrono::microseconds pollInterval =
+                   std::chrono::milliseconds(5))
+        : reader_(std::move(reader)),
+          channels_(reader_->channels()),
+          numberOfFrames_(reader_->numberOfFrames()),
+          ring_(utils::safeCast<size_t>(bufferFrames * channels_)),
+          blockFrames_((std::max)(
+              (std::min)(blockFrames, bufferFrames), uint64_t{1})),
+          block_(utils::safeCast<size_t>(blockFrames_ * channels_)),
+          pollInterval_(pollInterval) {
+      worker_ = std::thread(&Bw64Player::run, this);
+    }
+
+    Bw64Player(const Bw64Player&) = delete;
+    Bw64Player& operator=(const Bw64Player&) = delete;
+
+    /// destructor; this stops the worker, ignoring any error from it
+    ~Bw64Player() { stopWorker(); }
+
+    /**
+     * @brief Copy interleaved frames at the play position to outBuffer
+     *
+     * This is safe to call from a real-time thread. Any frames which have
+     * not been decoded yet, or are after the end of the file, are filled
+     * with zeros.
+     *
+     * @param[out] outBuffer buffer to write the samples to
+     * @param[in]  frames    number of frames to write
+     *
+     * @returns number of frames copied from the file; the play position
+     * moves on by this many frames
+     */
+    uint64_t pull(float* outBuffer, uint64_t frames) {
+      uint64_t count = 0;
+      if (flushedGeneration_.load(std::memory_order_relaxed) != generation_) {
+        // frames from before the last seek may still be in the ring buffer;
+        // once the worker acknowledges the seek it writes no more of these,
+        // and waits for them to be discarded before refilling. The
+        // acknowledgement must be loaded before discarding, so that all
+        // frames written before it are visible to the discard.
+        const bool acknowledged =
+            ackGeneration_.load(std::memory_order_acquire) == generation_;
+        ring_.discard();
+        if (acknowledged)
+          flushedGeneration_.store(generation_, std::memory_order_release);
+      } else {
+        const uint64_t available = ring_.readAvailable() / channels_;
+        count = (std::min)(frames, available);
+        ring_.read(outBuffer, static_cast<size_t>(count * channels_));
+        position_ += count;
+      }
+
+      if (count < frames) {
+        std::fill(outBuffer + count * channels_, outBuffer + frames * channels_,
+                  0.0f);
+        if (position_ < numberOfFrames_)
+          underruns_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return count;
+    }
+
+    /**
+     * @brief Move the play position to frame
+     *
+     * This does not block; the frames at the new position are available from
+     * pull() once the worker has decoded them.
+     */
+    void seek(uint64_t frame) {
+      position_ = (std::min)(frame, numberOfFrames_);
+      generation_++;
+      seekFrame_.store(position_, std::memory_order_relaxed);
+      seekGeneration_.store(generation_, std::memory_order_release);
+    }
+
+    /// @brief Get the play position in frames
+    uint64_t tell() const { return position_; }
+
+    /// @brief Get the number of decoded frames available to pull()
+    uint64_t bufferedFrames() const {
+      if (flushedGeneration_.load(std::memory_order_relaxed) != generation_)
+        return 0;
+      return ring_.readAvailable() / channels_;
+    }
+
+    /**
+     * @brief Stop the worker
+     *
+     * @throws std::runtime_error or any other error from the Bw64Reader,
+     * raised on the worker thread
+     */
+    void close() {
+      stopWorker();
+      if (error_) {
+        std::exception_ptr error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+      }
+    }
+
+    /// @brief Get number of channels
+    uint16_t channels() const { return channels_; }
+    /// @brief Get number of frames in the file
+    uint64_t numberOfFrames() const { return numberOfFrames_; }
+    /// @brief Get the capacity of the ring buffer in frames
+    uint64_t bufferFrames() const { return ring_.capacity() / channels_; }
+    /// @brief Get the number of pull() calls which were not filled from the
+    /// file, before the end of the file
+    uint64_t underruns() const {
+      return underruns_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    void stopWorker() {
+      if (!worker_.joinable()) return;
+      stop_.store(true, std::memory_order_relaxed);
+      worker_.join();
+    }
+
+    void run() {
+      uint64_t generation = 0;
+      uint64_t position = 0;
+      try {
+        while (!stop_.load(std::memory_order_relaxed)) {
+          const uint64_t requested =
+              seekGeneration_.load(std::memory_order_acquire);
+          if (requested != generation) {
+            // stop writing frames for the old position, and tell the
+            // consumer that everything in the ring buffer can be discarded
+            generation = requested;
+            position = seekFrame_.load(std::memory_order_relaxed);
+            ackGeneration_.store(generation, std::memory_order_release);
+          }
+
+          const uint64_t frames =
+              (std::min)(blockFrames_, numberOfFrames_ - position);
+          const bool flushed = flushedGeneration_.load(
+                                   std::memory_order_acquire) == generation;
+          if (!flushed || frames == 0 ||
+              ring_.writeAvailable() < frames * channels_) {
+            std::this_thread::sleep_for(pollInterval_);
+            continue;
+          }
+
+          if (reader_->readAt(position, block_.data(), frames) != frames)
+            throw std::runtime_error("file ended while reading frames");
+          ring_.write(block_.data(), static_cast<size_t>(frames * channels_));
+          position += frames;
+        }
+      } catch (...) {
+        // stop decoding; pull() outputs silence from now on
+        error_ = std::current_exception();
+      }
+    }
+
+    std::unique_ptr<Bw64Reader> reader_;
+    uint16_t channels_;
+    uint64_t numberOfFrames_;
+    utils::RingBuffer<float> ring_;
+    uint64_t blockFrames_;
+    /// frames decoded by the worker, to be written to ring_
+    std::vector<float> block_;
+    std::chrono::microseconds pollInterval_;
+
+    /// play position; used by the consumer only
+    uint64_t position_ = 0;
+    /// number of seeks; used by the consumer only
+    uint64_t generation_ = 0;
+    /// the seek handshake: seek() sets seekFrame_ and seekGeneration_; the
+    /// worker acknowledges it by setting ackGeneration_, after which pull()
+    /// empties ring_ and sets flushedGeneration_, then the worker refills
+    /// ring_
+    std::atomic<uint64_t> seekFrame_{0};
+    std::atomic<uint64_t> seekGeneration_{0};
+    std::atomic<uint64_t> ackGeneration_{0};
+    std::atomic<uint64_t> flushedGeneration_{0};
+
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> underruns_{0};
+    /// set by the worker before it exits; read after joining it
+    std::exception_ptr error_;
+
+    std::thread worker_;
+  };
+
+}  // namespace bw64
@@ -0,0 +1,173 @@
+/**
+ * @file probe.hpp
+ *
+ * Reading the format and chunk list of a BW64 file, without parsing or
+ * loading anything else.
+ */
+#pragma once
+#include <algorithm>
+#include <istream>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "chunks.hpp"
+#include "io.hpp"
+#include "parser.hpp"
+#include "utils.hpp"
+
+namespace bw64 {
+
+  /**
+   * @brief Summary of a BW64 file, as returned by probe()
+   */
+  struct FileInfo {
+    /// file format (RIFF, BW64 or RF64)
+    uint32_t fileFormat = 0;
+    /// format tag
+    uint16_t formatTag = 0;
+    /// number of channels
+    uint16_t channels = 0;
+    /// sample rate
+    uint32_t sampleRate = 0;
+    /// bit depth
+    uint16_t bitDepth = 0;
+    /// size of one frame in bytes
+    uint16_t blockAlignment = 0;
+    /// number of frames in the data chunk
+    uint64_t numberOfFrames = 0;
+    /// all chunks in the file, as returned by Bw64Reader::chunks()
+    std::vector<ChunkHeader> chunks;
+  };
+
+  /**
+   * @brief Read the format and chunk list of a BW64 file
+   *
+   * This reads only the RIFF header, the 'ds64' and 'fmt ' chunks and the
+   * header of each chunk, so is much cheaper than opening a Bw64Reader.
+   * The same checks are applied to these as in Bw64Reader.
+   *
+   * @param filename path of the file to read
+   *
+   * @throws std::runtime_error if the file can not be opened or is not a
+   * valid BW64 file
+   */
+  inline FileInfo probe(const std::string& filename) {
+    utils::File file(filename.c_str());
+    const uint64_t fileSize = file.size();
+    FileInfo info;
+
+    // the RIFF header and chunk headers are read into header; chunk bodies
+    // into body
+    char header[12];
+    std::vector<char> body;
+    utils::MemoryStreamBuf streamBuffer;
+    std::istream stream(&streamBuffer);
+    auto readAt = [&](char* data, uint64_t size, uint64_t offset) {
+      if (file.readAt(data, size, offset) != size)
+        throw std::runtime_error("file ended while reading value");
+      streamBuffer.setBuffer(data, size);
+      stream.clear();
+    };
+
+    uint32_t riffSize;
+    uint32_t riffType;
+    readAt(header, 12, 0);
+    utils::readValue(stream, info.fileFormat);
+    utils::readValue(stream, riffSize);
+    utils::readValue(stream, riffType);
+    if (info.fileFormat != utils::fourCC("RIFF") &&
+        info.fileFormat != utils::fourCC("BW64") &&
+        info.fileFormat != utils::fourCC("RF64")) {
+      throw std::runtime_error("File is not a RIFF, BW64 or RF64 file.");
+    }
+    if (riffType != utils::fourCC("WAVE")) {
+      throw std::runtime_error("File is not a WAVE file.");
+    }
+
+    std::shared_ptr<DataSize64Chunk> ds64Chunk;
+    uint64_t position = 12;
+    auto readHeader = [&]() {
+      uint32_t id;
+      uint32_t size;
+      readAt(header, 8, position);
+      utils::readValue(stream, id);
+      utils::readValue(stream, size);
+      uint64_t size64 = size;
+      if (ds64Chunk) {
+        if (id == utils::fourCC("data"))
+          size64 = ds64Chunk->dataSize();
+        else if (ds64Chunk->hasChunkSize(id))
+          size64 = ds64Chunk->getChunkSize(id);
+      }
+      return ChunkHeader(id, size64, position);
+    };
+    // read at most maxSize bytes of a chunk body, and point stream at them
+    auto readBody = [&](const ChunkHeader& chunkHeader, uint64_t maxSize) {
+      const uint64_t size = (std::min)(chunkHeader.size, maxSize);
+      body.resize(utils::safeCast<size_t>(size));
+      readAt(body.data(), size, chunkHeader.position + 8u);
+    };
+
+    if (info.fileFormat == utils::fourCC("BW64") ||
+        info.fileFormat == utils::fourCC("RF64")) {
+      if (position + 8u > fileSize)
+        throw std::runtime_error("file ended while reading value");
+      auto chunkHeader = readHeader();
+      if (chunkHeader.id != utils::fourCC("ds64")) {
+        throw std::runtime_error(
+            "mandatory ds64 chunk for BW64 or RF64 file not found");
+      }
+      if (chunkHeader.size > fileSize - position - 8u)
+        throw std::runtime_error("chunk ends after end of file");
+      readBody(chunkHeader, chunkHeader.size);
+      ds64Chunk =
+          parseDataSize64Chunk(stream, chunkHeader.id, chunkHeader.size);
+      info.chunks.push_back(chunkHeader);
+      position = chunkHeader.position + 8u + chunkHeader.size;
+    }
+
+    while (position + 8u <= fileSize) {
+      auto chunkHeader = readHeader();
+      // skip a padding byte
+      const uint64_t paddedSize =
+          utils::safeAdd<uint64_t>(chunkHeader.size, chunkHeader.size % 2);
+      const uint64_t end = utils::safeAdd<uint64_t>(position + 8u, paddedSize);
+      if (end > fileSize)
+        throw std::runtime_error("chunk ends after end of file");
+      info.chunks.push_back(chunkHeader);
+      position = end;
+    }
+
+    auto findChunk = [&](uint32_t id) {
+      return std::find_if(info.chunks.begin(), info.chunks.end(),
+                          [id](const ChunkHeader& chunkHeader) {
+                            return chunkHeader.id == id;
+                          });
+    };
+
+    auto fmtHeader = findChunk(utils::fourCC("fmt "));
+    if (fmtHeader == info.chunks.end())
+      throw std::runtime_error("mandatory fmt chunk not found");
+    // a valid fmt chunk has at most 18 bytes plus 16 bit cbSize of extra
+    // data; this is enough for the parser to reject larger chunks
+    readBody(*fmtHeader, 18u + UINT16_MAX);
+    auto formatChunk =
+        parseFormatInfoChunk(stream, fmtHeader->id, fmtHeader->size);
+    info.formatTag = formatChunk->formatTag();
+    info.channels = formatChunk->channelCount();
+    info.sampleRate = formatChunk->sampleRate();
+    info.bitDepth = formatChunk->bitsPerSample();
+    info.blockAlignment = formatChunk->blockAlignment();
+
+    auto dataHeader = findChunk(utils::fourCC("data"));
+    if (dataHeader == info.chunks.end())
+      throw std::runtime_error("mandatory data chunk not found");
+    if (info.blockAlignment)
+      info.numberOfFrames = dataHeader->size / info.blockAlignment;
+
+    return info;
+  }
+
+}  // namespace bw64
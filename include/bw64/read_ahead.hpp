@@ -0,0 +1,196 @@
+/**
+ * @file read_ahead.hpp
+ *
+ * Background reading of blocks of frames ahead of a sequential reader.
+ */
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <stdint.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace bw64 {
+  namespace utils {
+
+    /**
+     * @brief Buffer of undecoded frames, filled by a background thread ahead
+     * of the position of the consumer
+     *
+     * The thread reads blocks of frames with a positional read function, and
+     * keeps up to a fixed number of blocks queued after the last frame which
+     * was read. A read from any other position discards the queued blocks
+     * and restarts reading from there.
+     */
+    class ReadAheadBuffer {
+     public:
+      /// function to read frames into a buffer from a frame offset; this is
+      /// called from the background thread, and must throw on errors
+      using ReadFunction =
+          std::function<void(uint64_t frameOffset, char* buffer,
+                             uint64_t frames)>;
+
+      /**
+       * @param read           function used to read frames
+       * @param totalFrames    number of frames available
+       * @param blockAlignment size of one frame in bytes
+       * @param numBlocks      maximum number of blocks to read ahead
+       * @param blockFrames    number of frames per block
+       * @param startFrame     frame to start reading ahead from
+       */
+      ReadAheadBuffer(ReadFunction read, uint64_t totalFrames,
+                      uint16_t blockAlignment, unsigned numBlocks,
+                      uint64_t blockFrames, uint64_t startFrame = 0)
+          : read_(std::move(read)),
+            totalFrames_(totalFrames),
+            blockAlignment_(blockAlignment),
+            numBlocks_((std::max)(numBlocks, 1u)),
+            blockFrames_((std::max)(blockFrames, uint64_t{1})),
+            buffer_(numBlocks_ * blockFrames_ * blockAlignment_),
+            position_(startFrame),
+            blockStart_(startFrame) {
+        thread_ = std::thread(&ReadAheadBuffer::run, this);
+      }
+
+      ReadAheadBuffer(const ReadAheadBuffer&) = delete;
+      ReadAheadBuffer& operator=(const ReadAheadBuffer&) = delete;
+
+      ~ReadAheadBuffer() {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          stop_ = true;
+        }
+        changed_.notify_all();
+        thread_.join();
+      }
+
+      /**
+       * @brief Copy frames starting at frameOffset to outBuffer
+       *
+       * This waits for the background thread if the frames have not been
+       * read yet. Errors from the read function are rethrown here, and the
+       * read is tried again on the next call.
+       */
+      void read(uint64_t frameOffset, char* outBuffer, uint64_t frames) {
+        if (frameOffset > totalFrames_ || frames > totalFrames_ - frameOffset)
+          throw std::runtime_error("read ahead past the end of the frames");
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        // restart after a jump, or to try again after an error
+        if (frameOffset != position_ || error_) restart(frameOffset);
+
+        while (frames) {
+          changed_.wait(lock, [this]() { return queued_ || error_; });
+          if (!queued_) std::rethrow_exception(error_);
+
+          const uint64_t blockSize = currentBlockFrames(blockStart_);
+          const uint64_t offset = position_ - blockStart_;
+          const uint64_t count = (std::min)(frames, blockSize - offset);
+          const char* block = blockData(head_) + offset * blockAlignment_;
+          std::copy(block, block + count * blockAlignment_, outBuffer);
+
+          outBuffer += count * blockAlignment_;
+          frames -= count;
+          position_ += count;
+          if (position_ == blockStart_ + blockSize) {
+            head_ = (head_ + 1) % numBlocks_;
+            queued_--;
+            blockStart_ += blockSize;
+            changed_.notify_all();
+          }
+        }
+      }
+
+     private:
+      /// discard queued blocks and start reading from frame; mutex_ must be
+      /// held
+      void restart(uint64_t frame) {
+        generation_++;
+        position_ = blockStart_ = frame;
+        head_ = 0;
+        queued_ = 0;
+        error_ = nullptr;
+        changed_.notify_all();
+      }
+
+      /// number of frames in the block starting at frame
+      uint64_t currentBlockFrames(uint64_t frame) const {
+        return frame < totalFrames_ ? (std::min)(blockFrames_,
+                                                 totalFrames_ - frame)
+                                    : 0;
+      }
+
+      char* blockData(unsigned index) {
+        return buffer_.data() + index * blockFrames_ * blockAlignment_;
+      }
+
+      /// does the background thread have a block to read? mutex_ must be
+      /// held
+      bool canRead() const {
+        const uint64_t next = blockStart_ + queued_ * blockFrames_;
+        return queued_ < numBlocks_ && !error_ && next < totalFrames_;
+      }
+
+      void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+          changed_.wait(lock, [this]() { return stop_ || canRead(); });
+          if (stop_) return;
+
+          // read into the next free block with the mutex released; the
+          // consumer never reads blocks which are not queued, and a restart
+          // is detected by checking the generation
+          const uint64_t generation = generation_;
+          const uint64_t frame = blockStart_ + queued_ * blockFrames_;
+          const uint64_t frames = currentBlockFrames(frame);
+          char* block = blockData((head_ + queued_) % numBlocks_);
+          std::exception_ptr error;
+          lock.unlock();
+          try {
+            read_(frame, block, frames);
+          } catch (...) {
+            error = std::current_exception();
+          }
+          lock.lock();
+
+          if (generation != generation_) continue;
+          if (error)
+            error_ = error;
+          else
+            queued_++;
+          changed_.notify_all();
+        }
+      }
+
+      ReadFunction read_;
+      uint64_t totalFrames_;
+      uint16_t blockAlignment_;
+      unsigned numBlocks_;
+      uint64_t blockFrames_;
+      std::vector<char> buffer_;
+
+      std::mutex mutex_;
+      std::condition_variable changed_;
+      /// next frame to be read by the consumer
+      uint64_t position_;
+      /// first frame of the block at head_
+      uint64_t blockStart_;
+      /// index of the first queued block
+      unsigned head_ = 0;
+      /// number of blocks queued
+      unsigned queued_ = 0;
+      /// incremented by restart(), to discard reads already in progress
+      uint64_t generation_ = 0;
+      std::exception_ptr error_;
+      bool stop_ = false;
+
+      std::thread thread_;
+    };
+
+  }  // namespace utils
+}  // namespace bw64
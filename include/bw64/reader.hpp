@@ -1,15 +1,23 @@
 /// @file reader.hpp
 #pragma once
 #include <algorithm>
+#include <exception>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include "chunks.hpp"
+#include "io.hpp"
+#include "io_uring.hpp"
+#include "read_ahead.hpp"
 #include "utils.hpp"
 #include "parser.hpp"
 
@@ -17,6 +25,20 @@
 
 namespace bw64 {
 
+  /**
+   * @brief How a Bw64Reader accesses the file
+   */
+  enum class ReadMode {
+    /// read through a `std::ifstream`, copying each block of samples
+    stream,
+    /// map the whole file into memory, and parse and decode directly from the
+    /// mapping
+    mmap,
+    /// like stream, but read sample data with direct I/O (e.g. `O_DIRECT`),
+    /// bypassing the page cache, if supported by the platform and file system
+    direct
+  };
+
   /**
    * @brief Representation of a BW64 file
    *
@@ -33,17 +55,41 @@ namespace bw64 {
      * @brief Open a new BW64 file for reading
      *
      * Opens a new BW64 file for reading, parses the whole file to read the
-     * format and identify all chunks in it.
+     * format and identify all chunks in it. Only the 'ds64', 'fmt ' and
+     * 'data' chunks are parsed here; other chunks are loaded from the file
+     * when first accessed, see getChunk(). Errors in these other chunks (for
+     * example a malformed 'chna' chunk) are therefore thrown by the accessor,
+     * not by this constructor.
+     *
+     * @param filename path of the file to read
+     * @param mode how to access the file; ReadMode::mmap avoids copying the
+     * samples through a stream buffer, which is faster if the file is likely
+     * to be in the page cache; ReadMode::direct avoids filling the page cache
+     * when streaming through large files
      *
      * @note For convenience, you might consider using the `readFile` helper
      * function.
      */
-    Bw64Reader(const char* filename) {
-      fileStream_.open(filename, std::fstream::in | std::fstream::binary);
-      if (!fileStream_.is_open()) {
-        std::stringstream errorString;
-        errorString << "Could not open file: " << filename;
-        throw std::runtime_error(errorString.str());
+    Bw64Reader(const char* filename, ReadMode mode = ReadMode::stream)
+        : mode_(mode) {
+      if (mode_ == ReadMode::mmap) {
+        mappedFile_.open(filename);
+        mappedBuffer_.setBuffer(mappedFile_.data(), mappedFile_.size());
+        fileStream_.rdbuf(&mappedBuffer_);
+      } else {
+        if (!fileBuffer_.open(filename, std::ios::in | std::ios::binary))
+          utils::throwCouldNotOpen(filename);
+        fileStream_.rdbuf(&fileBuffer_);
+        // a separate handle for readAt(), which does not share the position
+        // of fileStream_; in ReadMode::direct this is also used for read()
+        positionalFile_.open(filename, utils::FileAccess::read,
+                             mode_ == ReadMode::direct);
+#ifdef BW64_IO_URING
+        if (mode_ == ReadMode::stream) {
+          ioUring_.reset(new utils::IoUring());
+          if (!ioUring_->isOpen()) ioUring_.reset();
+        }
+#endif
       }
       readRiffChunk();
       if (fileFormat_ == utils::fourCC("BW64") ||
@@ -53,30 +99,45 @@ namespace bw64 {
           throw std::runtime_error(
               "mandatory ds64 chunk for BW64 or RF64 file not found");
         }
-        auto ds64Chunk =
+        ds64Chunk_ =
             parseDataSize64Chunk(fileStream_, chunkHeader.id, chunkHeader.size);
-        chunks_.push_back(ds64Chunk);
         chunkHeaders_.push_back(chunkHeader);
       }
       parseChunkHeaders();
-      for (auto chunkHeader : chunkHeaders_) {
-        if (chunkHeader.id != utils::fourCC("ds64")) {
-          auto chunk = parseChunk(fileStream_, chunkHeader);
-          chunks_.push_back(chunk);
+
+      chunks_.resize(chunkHeaders_.size());
+      for (size_t i = 0; i < chunkHeaders_.size(); i++) {
+        const ChunkHeader& chunkHeader = chunkHeaders_[i];
+        // only the first chunk with each id can be accessed
+        if (!chunkIndex_.insert(std::make_pair(chunkHeader.id, i)).second)
+          continue;
+        if (chunkHeader.id == utils::fourCC("ds64")) {
+          chunks_[i] = ds64Chunk_;
+        } else if (chunkHeader.id == utils::fourCC("fmt ")) {
+          formatChunk_ = std::static_pointer_cast<FormatInfoChunk>(
+              parseChunk(fileStream_, chunkHeader));
+          chunks_[i] = formatChunk_;
+        } else if (chunkHeader.id == utils::fourCC("data")) {
+          dataChunk_ = std::static_pointer_cast<DataChunk>(
+              parseChunk(fileStream_, chunkHeader));
+          chunks_[i] = dataChunk_;
         }
       }
 
-      auto fmtChunk = formatChunk();
-      if (!fmtChunk) {
+      if (!formatChunk_) {
         throw std::runtime_error("mandatory fmt chunk not found");
       }
-      channelCount_ = fmtChunk->channelCount();
-      formatTag_ = fmtChunk->formatTag();
-      sampleRate_ = fmtChunk->sampleRate();
-      bitsPerSample_ = fmtChunk->bitsPerSample();
+      channelCount_ = formatChunk_->channelCount();
+      formatTag_ = formatChunk_->formatTag();
+      sampleRate_ = formatChunk_->sampleRate();
+      bitsPerSample_ = formatChunk_->bitsPerSample();
 
-      if (!dataChunk())
+      if (!dataChunk_)
         throw std::runtime_error("mandatory data chunk not found");
+      dataStart_ = getChunkHeader(utils::fourCC("data")).position + 8u;
+      blockAlignment_ = utils::safeCast<uint16_t>(
+          static_cast<uint32_t>(channelCount_) * bitsPerSample_ / 8);
+      numberOfFrames_ = dataChunk_->size() / blockAlignment_;
 
       seek(0);
     }
@@ -85,10 +146,24 @@ namespace bw64 {
     ///
     /// It is recommended to call this before the destructor, to handle
     /// exceptions.
+    ///
+    /// Chunks which have been accessed are kept, but others can no longer
+    /// be loaded, so accessing them throws; see getChunk().
     void close() {
-      if (!fileStream_.is_open()) return;
+      if (!fileBuffer_.is_open() && !mappedFile_.isOpen()) return;
 
-      fileStream_.close();
+      readAhead_.reset();
+#ifdef BW64_IO_URING
+      ioUring_.reset();
+#endif
+
+      if (mode_ == ReadMode::mmap) {
+        mappedBuffer_.setBuffer(nullptr, 0);
+        mappedFile_.close();
+      } else {
+        positionalFile_.close();
+        if (!fileBuffer_.close()) fileStream_.setstate(std::ios::failbit);
+      }
 
       if (!fileStream_.good())
         throw std::runtime_error("file error detected when closing");
@@ -98,6 +173,51 @@ namespace bw64 {
     /// but it is recommended to call close() first to handle exceptions
     ~Bw64Reader() { close(); }
 
+    /// @brief Get the mode used to access the file
+    ReadMode readMode() const { return mode_; }
+
+    /**
+     * @brief Set the number of threads used to decode large reads
+     *
+     * read() calls for many frames are split into frame-aligned slices, which
+     * are read and decoded concurrently by up to this many threads, using
+     * readAt(). Short reads always use the calling thread only.
+     *
+     * @param threads number of threads, including the calling thread; 0 uses
+     * one per hardware thread. The default is 1.
+     */
+    void setReadThreads(unsigned threads) {
+      if (threads == 0) threads = std::thread::hardware_concurrency();
+      readThreads_ = (std::max)(threads, 1u);
+    }
+    /// @brief Get the number of threads used to decode large reads
+    unsigned readThreads() const { return readThreads_; }
+
+    /**
+     * @brief Enable or disable reading ahead in a background thread
+     *
+     * When enabled, a background thread reads blocks of frames following the
+     * current position, so that reads from the current position can usually
+     * be served from memory. seek() or other jumps in position discard the
+     * blocks read so far. This is not supported in ReadMode::mmap.
+     *
+     * @param blocks      maximum number of blocks to read ahead, or 0 to
+     * disable reading ahead
+     * @param blockFrames number of frames in each block
+     */
+    void setReadAhead(unsigned blocks, uint64_t blockFrames = 16384) {
+      if (mode_ == ReadMode::mmap)
+        throw std::runtime_error(
+            "read ahead is not supported in ReadMode::mmap");
+
+      readAhead_.reset();
+      if (blocks == 0) return;
+      readAhead_.reset(new utils::ReadAheadBuffer(
+          [this](uint64_t frameOffset, char* buffer, uint64_t frames) {
+            readRawAt(frameOffset, buffer, frames);
+          },
+          numberOfFrames(), blockAlignment(), blocks, blockFrames, tell()));
+    }
     /// @brief Get file format (RIFF, BW64 or RF64)
     uint32_t fileFormat() const { return fileFormat_; }
     /// @brief Get file size
@@ -111,14 +231,9 @@ namespace bw64 {
     /// @brief Get bit depth
     uint16_t bitDepth() const { return bitsPerSample_; };
     /// @brief Get number of frames
-    uint64_t numberOfFrames() const {
-      return dataChunk()->size() / blockAlignment();
-    }
+    uint64_t numberOfFrames() const { return numberOfFrames_; }
     /// @brief Get block alignment
-    uint16_t blockAlignment() const {
-      return utils::safeCast<uint16_t>(static_cast<uint32_t>(channels()) *
-                                       bitDepth() / 8);
-    }
+    uint16_t blockAlignment() const { return blockAlignment_; }
 
     template <typename ChunkType>
     std::vector<std::shared_ptr<ChunkType>> chunksWithId(
@@ -153,9 +268,7 @@ namespace bw64 {
      * @returns `std::shared_ptr` to DataSize64Chunk if present and otherwise
      * a nullptr.
      */
-    std::shared_ptr<DataSize64Chunk> ds64Chunk() const {
-      return chunk<DataSize64Chunk>(chunks_, utils::fourCC("ds64"));
-    }
+    std::shared_ptr<DataSize64Chunk> ds64Chunk() const { return ds64Chunk_; }
     /**
      * @brief Get 'fmt ' chunk
      *
@@ -163,7 +276,7 @@ namespace bw64 {
      * a nullptr.
      */
     std::shared_ptr<FormatInfoChunk> formatChunk() const {
-      return chunk<FormatInfoChunk>(chunks_, utils::fourCC("fmt "));
+      return formatChunk_;
     }
     /**
      * @brief Get 'data' chunk
@@ -174,26 +287,57 @@ namespace bw64 {
      * @returns `std::shared_ptr` to DataChunk if present and otherwise
      * a nullptr.
      */
-    std::shared_ptr<DataChunk> dataChunk() const {
-      return chunk<DataChunk>(chunks_, utils::fourCC("data"));
-    }
+    std::shared_ptr<DataChunk> dataChunk() const { return dataChunk_; }
     /**
      * @brief Get 'chna' chunk
      *
      * @returns `std::shared_ptr` to ChnaChunk if present and otherwise a
      * nullptr.
+     *
+     * @throws std::runtime_error in the same cases as getChunk()
      */
     std::shared_ptr<ChnaChunk> chnaChunk() const {
-      return chunk<ChnaChunk>(chunks_, utils::fourCC("chna"));
+      return std::static_pointer_cast<ChnaChunk>(
+          getChunk(utils::fourCC("chna")));
     }
     /**
      * @brief Get 'axml' chunk
      *
      * @returns `std::shared_ptr` to AxmlChunk if present and otherwise a
      * nullptr.
+     *
+     * @throws std::runtime_error in the same cases as getChunk()
      */
     std::shared_ptr<AxmlChunk> axmlChunk() const {
-      return chunk<AxmlChunk>(chunks_, utils::fourCC("axml"));
+      return std::static_pointer_cast<AxmlChunk>(
+          getChunk(utils::fourCC("axml")));
+    }
+
+    /**
+     * @brief Get the first chunk with the given id
+     *
+     * Chunks are parsed from the file on first access and kept afterwards.
+     * Chunks of unknown types are returned as an UnknownChunk holding the
+     * whole chunk body.
+     *
+     * This may be called from several threads at once, and does not change
+     * the current position.
+     *
+     * @returns `std::shared_ptr` to the chunk if present and otherwise a
+     * nullptr.
+     *
+     * @throws std::runtime_error if the chunk is malformed, or if it was not
+     * accessed before close(); a chunk which fails to load is tried again on
+     * the next call
+     */
+    std::shared_ptr<Chunk> getChunk(uint32_t id) const {
+      auto index = chunkIndex_.find(id);
+      if (index == chunkIndex_.end()) return nullptr;
+
+      std::lock_guard<std::mutex> lock(chunksMutex_);
+      std::shared_ptr<Chunk>& chunk = chunks_[index->second];
+      if (!chunk) chunk = loadChunk(chunkHeaders_[index->second]);
+      return chunk;
     }
 
     /**
@@ -204,15 +348,67 @@ namespace bw64 {
     /**
      * @brief Check if a chunk with the given id is present
      */
-    bool hasChunk(uint32_t id) const {
-      auto foundHeader = std::find_if(
-          chunkHeaders_.begin(), chunkHeaders_.end(),
-          [id](const ChunkHeader header) { return header.id == id; });
-      if (foundHeader == chunkHeaders_.end()) {
-        return false;
-      } else {
-        return true;
+    bool hasChunk(uint32_t id) const { return chunkIndex_.count(id) != 0; }
+
+    /**
+     * @brief Find the channels used by an audioPackFormat
+     *
+     * @param packRef audioPackFormatID to look for in the 'chna' chunk, e.g.
+     * `"AP_00031001"`
+     *
+     * @returns indices (from 0) of the channels of all tracks which reference
+     * packRef, in the order in which they first appear in the 'chna' chunk;
+     * these can be passed to readChannels()
+     *
+     * @throws std::runtime_error if there is no 'chna' chunk, or no track
+     * references packRef
+     */
+    std::vector<uint16_t> channelsForPackFormat(
+        const std::string& packRef) const {
+      std::vector<uint16_t> channels;
+      for (const auto& audioId : chnaAudioIds()) {
+        if (audioId.packRef() != packRef) continue;
+        const uint16_t channel = channelForAudioId(audioId);
+        if (std::find(channels.begin(), channels.end(), channel) ==
+            channels.end())
+          channels.push_back(channel);
       }
+      if (channels.empty()) {
+        std::stringstream errorMsg;
+        errorMsg << "no tracks found for audioPackFormat '" << packRef << "'";
+        throw std::runtime_error(errorMsg.str());
+      }
+      return channels;
+    }
+
+    /**
+     * @brief Find the channels used by a list of audioTrackUIDs
+     *
+     * @param uids audioTrackUIDs to look for in the 'chna' chunk, e.g.
+     * `"ATU_00000001"`
+     *
+     * @returns index (from 0) of the channel of each of uids, in the same
+     * order; these can be passed to readChannels()
+     *
+     * @throws std::runtime_error if there is no 'chna' chunk, or one of uids
+     * is not found
+     */
+    std::vector<uint16_t> channelsForTrackUids(
+        const std::vector<std::string>& uids) const {
+      const std::vector<AudioId> audioIds = chnaAudioIds();
+      std::vector<uint16_t> channels;
+      for (const auto& uid : uids) {
+        auto audioId = std::find_if(
+            audioIds.begin(), audioIds.end(),
+            [&uid](const AudioId& audioId) { return audioId.uid() == uid; });
+        if (audioId == audioIds.end()) {
+          std::stringstream errorMsg;
+          errorMsg << "audioTrackUID '" << uid << "' not found";
+          throw std::runtime_error(errorMsg.str());
+        }
+        channels.push_back(channelForAudioId(*audioId));
+      }
+      return channels;
     }
 
     /**
@@ -238,16 +434,8 @@ namespace bw64 {
       else if (frame > numberOfFramesInt)
         frame = numberOfFramesInt;
 
-      // the position in the file of the frame
-      const int64_t dataStartPos =
-          getChunkHeader(utils::fourCC("data")).position + 8;
-      const int64_t framePos =
-          dataStartPos + frame * static_cast<int64_t>(blockAlignment());
-
-      fileStream_.seekg(framePos);
-
-      if (!fileStream_.good())
-        throw std::runtime_error("file error while seeking");
+      // fileStream_ is moved on the next read, if it is used
+      currentFrame_ = static_cast<uint64_t>(frame);
     }
 
     /**
@@ -261,42 +449,266 @@ namespace bw64 {
     template <typename T, typename std::enable_if<
                               std::is_floating_point<T>::value, int>::type = 0>
     uint64_t read(T* outBuffer, uint64_t frames) {
-      if (tell() + frames > numberOfFrames()) {
-        frames = numberOfFrames() - tell();
+      frames = clampFrames(frames);
+
+      if (parallelReadSlices(frames) > 1) {
+        readParallel(currentFrame_, outBuffer, frames);
+        currentFrame_ += frames;
+      } else if (frames) {
+        const char* rawData = readRawData(frames * blockAlignment());
+        utils::decodePcmSamples(rawData, outBuffer, frames * channels(),
+                                bitDepth());
       }
 
+      return frames;
+    }
+
+    /**
+     * @brief Read frames from dataChunk as integers
+     *
+     * Samples are converted to `int16_t`, Int24 or `int32_t` by
+     * shifting, without scaling or clipping; see Justification.
+     *
+     * @param[out] outBuffer     Buffer to write the samples to
+     * @param[in]  frames        Number of frames to read
+     * @param[in]  justification How samples are placed in the integers
+     *
+     * @returns number of frames read
+     */
+    template <typename T, typename std::enable_if<
+                              utils::IsIntSample<T>::value, int>::type = 0>
+    uint64_t read(T* outBuffer, uint64_t frames,
+                  Justification justification = Justification::left) {
+      // check that the conversion is possible before moving the position
+      utils::intSampleShift<T>(bitDepth(), justification);
+
+      frames = clampFrames(frames);
+
       if (frames) {
-        rawDataBuffer_.resize(frames * blockAlignment());
-        fileStream_.read(rawDataBuffer_.data(), frames * blockAlignment());
-        if (fileStream_.eof())
-          throw std::runtime_error("file ended while reading frames");
-        if (!fileStream_.good())
-          throw std::runtime_error("file error while reading frames");
+        const char* rawData = readRawData(frames * blockAlignment());
+        utils::decodePcmSamples(rawData, outBuffer, frames * channels(),
+                                bitDepth(), justification);
+      }
+
+      return frames;
+    }
 
-        utils::decodePcmSamples(rawDataBuffer_.data(), outBuffer,
+    /**
+     * @brief Read frames from dataChunk into one buffer per channel
+     *
+     * Samples are decoded directly into the channel buffers, without an
+     * intermediate interleaved buffer.
+     *
+     * @param[out] channelBuffers `channels()` buffers of at least `frames`
+     * samples each
+     * @param[in]  frames         Number of frames to read
+     *
+     * @returns number of frames read
+     */
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    uint64_t readPlanar(T* const* channelBuffers, uint64_t frames) {
+      frames = clampFrames(frames);
+
+      const uint64_t blockFrames = readBlockFrames(frames);
+      for (uint64_t done = 0; done < frames;) {
+        const uint64_t blockSize = (std::min)(blockFrames, frames - done);
+        const char* rawData = readRawData(blockSize * blockAlignment());
+        utils::decodePcmSamplesPlanar(rawData, channelBuffers, done, blockSize,
+                                      channels(), bitDepth());
+        done += blockSize;
+      }
+
+      return frames;
+    }
+
+    /**
+     * @brief Read some of the channels of frames from dataChunk
+     *
+     * Only the samples of the selected channels are decoded. In
+     * ReadMode::mmap they are decoded directly from the mapping, so the
+     * other samples are not touched unless they share a cache line.
+     *
+     * @param[out] outBuffer Buffer to write `frames * channels.size()` samples
+     * to, interleaved in the order given by `channels`
+     * @param[in]  frames    Number of frames to read
+     * @param[in]  channels  Indices of the channels to read, from 0; channels
+     * may be given more than once
+     *
+     * @returns number of frames read
+     */
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    uint64_t readChannels(T* outBuffer, uint64_t frames,
+                          const std::vector<uint16_t>& channels) {
+      // check the channels before moving the position
+      for (uint16_t channel : channels) {
+        if (channel >= this->channels()) {
+          std::stringstream errorMsg;
+          errorMsg << "channel index " << channel << " out of range for file "
+                   << "with " << this->channels() << " channels";
+          throw std::runtime_error(errorMsg.str());
+        }
+      }
+      const uint16_t numSelected = utils::safeCast<uint16_t>(channels.size());
+
+      frames = clampFrames(frames);
+
+      const uint64_t blockFrames = readBlockFrames(frames);
+      for (uint64_t done = 0; done < frames;) {
+        const uint64_t blockSize = (std::min)(blockFrames, frames - done);
+        const char* rawData = readRawData(blockSize * blockAlignment());
+        utils::decodePcmChannels(rawData, outBuffer + done * numSelected,
+                                 blockSize, this->channels(), channels.data(),
+                                 numSelected, bitDepth());
+        done += blockSize;
+      }
+
+      return frames;
+    }
+
+    /**
+     * @brief Read the channels of an audioPackFormat from dataChunk
+     *
+     * This is readChannels() with the channels from channelsForPackFormat().
+     *
+     * @param[out] outBuffer Buffer to write the samples to
+     * @param[in]  frames    Number of frames to read
+     * @param[in]  packRef   audioPackFormatID to read
+     *
+     * @returns number of frames read
+     */
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    uint64_t readPackFormat(T* outBuffer, uint64_t frames,
+                            const std::string& packRef) {
+      return readChannels(outBuffer, frames, channelsForPackFormat(packRef));
+    }
+
+    /**
+     * @brief Read the channels of some audioTrackUIDs from dataChunk
+     *
+     * This is readChannels() with the channels from channelsForTrackUids().
+     *
+     * @param[out] outBuffer Buffer to write the samples to
+     * @param[in]  frames    Number of frames to read
+     * @param[in]  uids      audioTrackUIDs to read, in the order in which they
+     * are written to each frame of outBuffer
+     *
+     * @returns number of frames read
+     */
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    uint64_t readTrackUids(T* outBuffer, uint64_t frames,
+                           const std::vector<std::string>& uids) {
+      return readChannels(outBuffer, frames, channelsForTrackUids(uids));
+    }
+
+    /**
+     * @brief Read frames from a given position in dataChunk
+     *
+     * Unlike read(), this does not use or change the current position (see
+     * seek() and tell()), and may be called from several threads at once,
+     * including while another thread uses read(). In ReadMode::stream and
+     * ReadMode::direct it uses a separate file handle with positional reads;
+     * in ReadMode::mmap it decodes directly from the mapping.
+     *
+     * @param[in]  frameOffset Index of the first frame to read
+     * @param[out] outBuffer   Buffer to write the samples to
+     * @param[in]  frames      Number of frames to read
+     *
+     * @returns number of frames read, which is less than frames only if the
+     * end of dataChunk is reached
+     */
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    uint64_t readAt(uint64_t frameOffset, T* outBuffer, uint64_t frames) const {
+      if (frameOffset >= numberOfFrames()) return 0;
+      frames = (std::min)(frames, numberOfFrames() - frameOffset);
+
+      if (mode_ == ReadMode::mmap) {
+        utils::decodePcmSamples(mappedFile_.data() + framePosition(frameOffset),
+                                outBuffer,
                                 frames * channels(), bitDepth());
+        return frames;
+      }
+
+      // each call has its own buffer, as rawDataBuffer_ can't be shared
+      std::vector<char> rawData;
+      const uint64_t blockFrames = readBlockFrames(frames);
+      for (uint64_t done = 0; done < frames;) {
+        const uint64_t blockSize = (std::min)(blockFrames, frames - done);
+        rawData.resize(blockSize * blockAlignment());
+        readRawAt(frameOffset + done, rawData.data(), blockSize);
+        utils::decodePcmSamples(rawData.data(), outBuffer + done * channels(),
+                                blockSize * channels(), bitDepth());
+        done += blockSize;
       }
 
       return frames;
     }
 
+    /**
+     * @brief Read undecoded frames from dataChunk
+     *
+     * The samples are copied as they are stored in the file: interleaved,
+     * little endian, with `bitDepth() / 8` bytes per sample.
+     *
+     * @param[out] outBuffer Buffer of at least `frames * blockAlignment()`
+     * bytes to copy the frames to
+     * @param[in]  frames    Number of frames to read
+     *
+     * @returns number of frames read
+     */
+    uint64_t readRaw(char* outBuffer, uint64_t frames) {
+      frames = clampFrames(frames);
+
+      if (frames) {
+        const uint64_t size = frames * blockAlignment();
+        if (mode_ == ReadMode::mmap)
+          std::copy_n(readRawData(size), size, outBuffer);
+        else
+          readStreamData(outBuffer, size);
+      }
+
+      return frames;
+    }
+
+    /**
+     * @brief Access undecoded frames from dataChunk without copying them
+     *
+     * Like readRaw(), but rather than copying the frames, `data` is pointed at
+     * them inside the mapping. This is only possible in ReadMode::mmap; the
+     * pointer stays valid until the file is closed.
+     *
+     * @param[out] data   Set to point to the first frame
+     * @param[in]  frames Number of frames to read
+     *
+     * @returns number of frames available at `data`
+     */
+    uint64_t viewRaw(const char** data, uint64_t frames) {
+      if (mode_ != ReadMode::mmap)
+        throw std::runtime_error("viewRaw is only supported in ReadMode::mmap");
+
+      frames = clampFrames(frames);
+      *data = frames ? readRawData(frames * blockAlignment()) : nullptr;
+
+      return frames;
+    }
+
     /**
      * @brief Tell the current frame position of the dataChunk
      *
      * @returns current frame position of the dataChunk
      */
-    uint64_t tell() {
-      return ((uint64_t)fileStream_.tellg() -
-              getChunkHeader(utils::fourCC("data")).position - 8u) /
-             formatChunk()->blockAlignment();
-    }
+    uint64_t tell() const { return currentFrame_; }
 
     /**
      * @brief Check if end of data is reached
      *
      * @returns `true` if end of data is reached and otherwise `false`
      */
-    bool eof() { return tell() == numberOfFrames(); }
+    bool eof() const { return currentFrame_ == numberOfFrames_; }
 
    private:
     void readRiffChunk() {
@@ -315,12 +727,215 @@ namespace bw64 {
       }
     }
 
-    ChunkHeader getChunkHeader(uint32_t id) {
-      auto foundHeader = std::find_if(
-          chunkHeaders_.begin(), chunkHeaders_.end(),
-          [id](const ChunkHeader header) { return header.id == id; });
-      if (foundHeader != chunkHeaders_.end()) {
-        return *foundHeader;
+    /// limit a number of frames to those remaining in the data chunk
+    uint64_t clampFrames(uint64_t frames) const {
+      return (std::min)(frames, numberOfFrames_ - currentFrame_);
+    }
+
+    /// position in the file of a frame in the data chunk
+    uint64_t framePosition(uint64_t frame) const {
+      return dataStart_ + frame * blockAlignment_;
+    }
+
+    /// number of slices to split a read of some frames into
+    unsigned parallelReadSlices(uint64_t frames) const {
+      // smaller slices are not worth the overhead of starting a thread
+      const uint64_t minSliceFrames = 16384;
+      const uint64_t slices = frames / minSliceFrames;
+      return static_cast<unsigned>(
+          (std::min)(slices, static_cast<uint64_t>(readThreads_)));
+    }
+
+    /// read frames with readAt() in parallel slices on new threads and the
+    /// calling thread
+    template <typename T>
+    void readParallel(uint64_t frameOffset, T* outBuffer,
+                      uint64_t frames) const {
+      const unsigned slices = parallelReadSlices(frames);
+      const uint64_t sliceFrames = (frames + slices - 1) / slices;
+
+      std::vector<std::exception_ptr> errors(slices);
+      auto readSlice = [&](unsigned slice) {
+        const uint64_t start = slice * sliceFrames;
+        const uint64_t size = (std::min)(sliceFrames, frames - start);
+        try {
+          if (readAt(frameOffset + start, outBuffer + start * channels(),
+                     size) != size)
+            throw std::runtime_error("file ended while reading frames");
+        } catch (...) {
+          errors[slice] = std::current_exception();
+        }
+      };
+
+      std::vector<std::thread> threads;
+      threads.reserve(slices - 1);
+      unsigned slice = 1;
+      try {
+        for (; slice < slices; slice++) threads.emplace_back(readSlice, slice);
+      } catch (const std::system_error&) {
+        // no more threads could be started; read the rest on this one
+      }
+      for (; slice < slices; slice++) readSlice(slice);
+      readSlice(0);
+      for (auto& thread : threads) thread.join();
+
+      for (auto& error : errors)
+        if (error) std::rethrow_exception(error);
+    }
+
+    /// the entries of the 'chna' chunk; throws if there isn't one
+    std::vector<AudioId> chnaAudioIds() const {
+      auto chna = chnaChunk();
+      if (!chna) throw std::runtime_error("no chna chunk found");
+      return chna->audioIds();
+    }
+
+    /// the channel index (from 0) of the track of a 'chna' entry
+    uint16_t channelForAudioId(const AudioId& audioId) const {
+      if (audioId.trackIndex() < 1 || audioId.trackIndex() > channels()) {
+        std::stringstream errorMsg;
+        errorMsg << "chna track index " << audioId.trackIndex()
+                 << " out of range for file with " << channels()
+                 << " channels";
+        throw std::runtime_error(errorMsg.str());
+      }
+      return audioId.trackIndex() - 1;
+    }
+
+    /// number of frames to read at once when reading frames in pieces
+    ///
+    /// In stream mode this is about 1MB, to limit the size of rawDataBuffer_.
+    uint64_t readBlockFrames(uint64_t frames) const {
+      if (mode_ == ReadMode::mmap) return frames;
+      const uint64_t maxBlockSize = uint64_t{1} << 20;
+      return (std::max)(uint64_t{1}, maxBlockSize / blockAlignment());
+    }
+
+    /// read size bytes at the current position, returning a pointer to them
+    ///
+    /// In ReadMode::mmap this points into the mapping, in ReadMode::direct
+    /// into directBuffer_, otherwise into rawDataBuffer_; it is only valid
+    /// until the next read.
+    const char* readRawData(uint64_t size) {
+      if (mode_ == ReadMode::mmap) {
+        const char* data = mappedFile_.data() + framePosition(currentFrame_);
+        currentFrame_ += size / blockAlignment_;
+        return data;
+      }
+      if (mode_ == ReadMode::direct && !readAhead_) return readDirectData(size);
+
+#ifdef BW64_IO_URING
+      // the registered buffer must not be freed while it is in use
+      if (ioUring_ && size > rawDataBuffer_.capacity())
+        ioUring_->unregisterBuffer();
+#endif
+      rawDataBuffer_.resize(size);
+#ifdef BW64_IO_URING
+      if (ioUring_)
+        ioUring_->useBuffer(rawDataBuffer_.data(), rawDataBuffer_.capacity());
+#endif
+      readStreamData(rawDataBuffer_.data(), size);
+      return rawDataBuffer_.data();
+    }
+
+    /// read size bytes at the current position in ReadMode::stream or
+    /// ReadMode::direct, from readAhead_, positionalFile_, ioUring_ or
+    /// fileStream_
+    void readStreamData(char* outBuffer, uint64_t size) {
+      if (readAhead_) {
+        readAheadRawData(outBuffer, size);
+        return;
+      }
+      if (mode_ == ReadMode::direct) {
+        std::copy_n(readDirectData(size), size, outBuffer);
+        return;
+      }
+
+#ifdef BW64_IO_URING
+      if (ioUring_) {
+        if (ioUring_->readAt(positionalFile_.fd(), outBuffer, size,
+                             framePosition(currentFrame_)) != size)
+          throw std::runtime_error("file ended while reading frames");
+        currentFrame_ += size / blockAlignment_;
+        return;
+      }
+#endif
+
+      // fileStream_ is only moved when the position is changed by something
+      // other than reading from it
+      if (streamFrame_ != currentFrame_) {
+        streamFrame_ = noFrame;
+        fileStream_.seekg(
+            utils::safeCast<std::streamoff>(framePosition(currentFrame_)));
+        if (!fileStream_.good())
+          throw std::runtime_error("file error while seeking");
+      }
+      fileStream_.read(outBuffer, size);
+      if (fileStream_.eof())
+        throw std::runtime_error("file ended while reading frames");
+      if (!fileStream_.good())
+        throw std::runtime_error("file error while reading frames");
+      currentFrame_ += size / blockAlignment_;
+      streamFrame_ = currentFrame_;
+    }
+
+    /// copy size bytes at the current position from readAhead_, and move
+    /// the position past them
+    void readAheadRawData(char* outBuffer, uint64_t size) {
+      readAhead_->read(currentFrame_, outBuffer, size / blockAlignment_);
+      currentFrame_ += size / blockAlignment_;
+    }
+
+    /// read size bytes at the current position from positionalFile_ in
+    /// ReadMode::direct, returning a pointer into directBuffer_
+    const char* readDirectData(uint64_t size) {
+      const char* data = utils::readAligned(
+          positionalFile_, directBuffer_, framePosition(currentFrame_), size);
+      currentFrame_ += size / blockAlignment_;
+      return data;
+    }
+
+    /// read undecoded frames from a frame offset without using fileStream_;
+    /// throws if they are not all read
+    void readRawAt(uint64_t frameOffset, char* outBuffer,
+                   uint64_t frames) const {
+      const uint64_t position = framePosition(frameOffset);
+      const uint64_t size = frames * blockAlignment_;
+      if (mode_ == ReadMode::mmap) {
+        std::copy_n(mappedFile_.data() + position, size, outBuffer);
+      } else if (mode_ == ReadMode::direct) {
+        // each call has its own buffer, as directBuffer_ can't be shared
+        utils::AlignedBuffer buffer;
+        std::copy_n(utils::readAligned(positionalFile_, buffer, position, size),
+                    size, outBuffer);
+      } else if (positionalFile_.readAt(outBuffer, size, position) != size) {
+        throw std::runtime_error("file ended while reading frames");
+      }
+    }
+
+    /// parse a chunk without using fileStream_, so that this can be used
+    /// from const methods
+    std::shared_ptr<Chunk> loadChunk(const ChunkHeader& header) const {
+      if (!fileBuffer_.is_open() && !mappedFile_.isOpen())
+        throw std::runtime_error("can not load chunk after closing the file");
+
+      const uint64_t size = header.size + 8u;
+      utils::AlignedBuffer buffer;
+      const char* data =
+          mode_ == ReadMode::mmap
+              ? mappedFile_.data() + header.position
+              : utils::readAligned(positionalFile_, buffer, header.position,
+                                   size);
+
+      utils::MemoryStreamBuf streamBuffer(data, size);
+      std::istream stream(&streamBuffer);
+      return parseChunk(stream, ChunkHeader(header.id, header.size, 0));
+    }
+
+    ChunkHeader getChunkHeader(uint32_t id) const {
+      auto index = chunkIndex_.find(id);
+      if (index != chunkIndex_.end()) {
+        return chunkHeaders_[index->second];
       }
       std::stringstream errorMsg;
       errorMsg << "no chunk with id '" << utils::fourCCToStr(id) << "' found";
@@ -338,15 +953,15 @@ namespace bw64 {
     }
 
     uint64_t getChunkSize64(uint32_t id, uint64_t chunkSize) {
-      if (ds64Chunk()) {
+      if (ds64Chunk_) {
         if (id == utils::fourCC("BW64") || id == utils::fourCC("RF64")) {
-          return ds64Chunk()->bw64Size();
+          return ds64Chunk_->bw64Size();
         }
         if (id == utils::fourCC("data")) {
-          return ds64Chunk()->dataSize();
+          return ds64Chunk_->dataSize();
         }
-        if (ds64Chunk()->hasChunkSize(id)) {
-          return ds64Chunk()->getChunkSize(id);
+        if (ds64Chunk_->hasChunkSize(id)) {
+          return ds64Chunk_->getChunkSize(id);
         }
       }
       return chunkSize;
@@ -384,16 +999,48 @@ namespace bw64 {
       }
     }
 
-    std::ifstream fileStream_;
+    ReadMode mode_;
+    std::filebuf fileBuffer_;
+    utils::MappedFile mappedFile_;
+    utils::MemoryStreamBuf mappedBuffer_;
+    utils::File positionalFile_;
+    std::istream fileStream_{nullptr};
     uint32_t fileFormat_;
     uint32_t fileSize_;
     uint16_t channelCount_;
     uint32_t sampleRate_;
     uint16_t formatTag_;
     uint16_t bitsPerSample_;
+    unsigned readThreads_ = 1;
+
+    // cached from the fmt and data chunks
+    uint64_t dataStart_;
+    uint16_t blockAlignment_;
+    uint64_t numberOfFrames_;
+    // frame position used by read(), and the frame fileStream_ is positioned
+    // at, or noFrame if unknown
+    static const uint64_t noFrame = UINT64_MAX;
+    uint64_t currentFrame_ = 0;
+    uint64_t streamFrame_ = noFrame;
 
     std::vector<char> rawDataBuffer_;
-    std::vector<std::shared_ptr<Chunk>> chunks_;
+    utils::AlignedBuffer directBuffer_;
     std::vector<ChunkHeader> chunkHeaders_;
+    // index in chunkHeaders_ of the first chunk with each id
+    std::unordered_map<uint32_t, size_t> chunkIndex_;
+    // parsed chunks, by index in chunkHeaders_; 'ds64', 'fmt ' and 'data'
+    // are parsed when opening the file, others on first access
+    mutable std::vector<std::shared_ptr<Chunk>> chunks_;
+    mutable std::mutex chunksMutex_;
+    std::shared_ptr<DataSize64Chunk> ds64Chunk_;
+    std::shared_ptr<FormatInfoChunk> formatChunk_;
+    std::shared_ptr<DataChunk> dataChunk_;
+#ifdef BW64_IO_URING
+    // used for sample data in ReadMode::stream if supported; after
+    // rawDataBuffer_, as it may be registered
+    std::unique_ptr<utils::IoUring> ioUring_;
+#endif
+    // last, as the thread uses the rest of the reader
+    std::unique_ptr<utils::ReadAheadBuffer> readAhead_;
   };
 }  // namespace bw64
@@ -0,0 +1,118 @@
+/**
+ * @file ring_buffer.hpp
+ *
+ * Lock-free single-producer single-consumer ring buffer, for passing samples
+ * between a real-time thread and a worker thread.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+namespace bw64 {
+  namespace utils {
+
+    /**
+     * @brief Fixed-size single-producer single-consumer queue of values
+     *
+     * One thread may call write() and writeAvailable() while one other
+     * thread calls read() and readAvailable(). These never block, allocate or
+     * make system calls.
+     */
+    template <typename T>
+    class RingBuffer {
+     public:
+      /// @param capacity maximum number of values held at once
+      explicit RingBuffer(size_t capacity) : buffer_(capacity + 1) {}
+
+      RingBuffer(const RingBuffer&) = delete;
+      RingBuffer& operator=(const RingBuffer&) = delete;
+
+      /// @brief Maximum number of values held at once
+      size_t capacity() const { return buffer_.size() - 1; }
+
+      /// @brief Number of values which can be written; producer only
+      size_t writeAvailable() const {
+        const size_t write = writeIndex_.load(std::memory_order_relaxed);
+        const size_t read = readIndex_.load(std::memory_order_acquire);
+        return capacity() - distance(read, write);
+      }
+
+      /// @brief Number of values which can be read; consumer only
+      size_t readAvailable() const {
+        const size_t read = readIndex_.load(std::memory_order_relaxed);
+        const size_t write = writeIndex_.load(std::memory_order_acquire);
+        return distance(read, write);
+      }
+
+      /**
+       * @brief Append values; producer only
+       *
+       * @returns number of values written, which is less than count if there
+       * is not enough space
+       */
+      size_t write(const T* data, size_t count) {
+        const size_t write = writeIndex_.load(std::memory_order_relaxed);
+        count = (std::min)(count, writeAvailable());
+
+        // copy in up to two parts, wrapping at the end of buffer_
+        const size_t first = (std::min)(count, buffer_.size() - write);
+        std::copy_n(data, first, buffer_.begin() + write);
+        std::copy_n(data + first, count - first, buffer_.begin());
+
+        writeIndex_.store(wrap(write + count), std::memory_order_release);
+        return count;
+      }
+
+      /**
+       * @brief Remove values from the front; consumer only
+       *
+       * @returns number of values read, which is less than count if there
+       * are not enough values available
+       */
+      size_t read(T* data, size_t count) {
+        const size_t read = readIndex_.load(std::memory_order_relaxed);
+        count = (std::min)(count, readAvailable());
+
+        const size_t first = (std::min)(count, buffer_.size() - read);
+        std::copy_n(buffer_.begin() + read, first, data);
+        std::copy_n(buffer_.begin(), count - first, data + first);
+
+        readIndex_.store(wrap(read + count), std::memory_order_release);
+        return count;
+      }
+
+      /**
+       * @brief Remove all values; consumer only
+       *
+       * @returns number of values removed
+       */
+      size_t discard() {
+        const size_t read = readIndex_.load(std::memory_order_relaxed);
+        const size_t count = readAvailable();
+        readIndex_.store(wrap(read + count), std::memory_order_release);
+        return count;
+      }
+
+     private:
+      size_t wrap(size_t index) const {
+        return index >= buffer_.size() ? index - buffer_.size() : index;
+      }
+
+      size_t distance(size_t read, size_t write) const {
+        return write >= read ? write - read : write + buffer_.size() - read;
+      }
+
+      // one slot is always left empty, to tell a full buffer from an empty
+      // one
+      std::vector<T> buffer_;
+      // on separate cache lines, as they are written by different threads
+      char padding0_[64];
+      std::atomic<size_t> readIndex_{0};
+      char padding1_[64];
+      std::atomic<size_t> writeIndex_{0};
+    };
+
+  }  // namespace utils
+}  // namespace bw64
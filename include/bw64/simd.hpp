@@ -0,0 +1,661 @@
+/**
+ * @file simd.hpp
+ *
+ * Vectorised PCM conversion kernels for x86 CPUs, selected at runtime
+ * according to the instruction sets the CPU supports.
+ *
+ * Each kernel converts as many samples as it can in whole vectors, and
+ * returns the number of samples converted; the remainder is left to the
+ * scalar code in utils.hpp. Results are bit-identical to the scalar code.
+ *
+ * Define `BW64_NO_SIMD` to disable the kernels.
+ */
+#pragma once
+#include <cstring>
+#include <stdint.h>
+
+#if !defined(BW64_NO_SIMD) &&                                         \
+    (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+     defined(_M_IX86))
+#define BW64_SIMD_X86
+#endif
+
+// AVX-512 intrinsics need a reasonably recent compiler
+#if defined(BW64_SIMD_X86) &&                                     \
+    (defined(__clang__) || !defined(__GNUC__) || __GNUC__ >= 6) && \
+    (!defined(_MSC_VER) || _MSC_VER >= 1910)
+#define BW64_SIMD_AVX512
+#endif
+
+#ifdef BW64_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and clang need functions using intrinsics to be marked with the
+// instruction sets they use; MSVC always allows them
+#if defined(__GNUC__) || defined(__clang__)
+#define BW64_SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BW64_SIMD_TARGET(isa)
+#endif
+
+namespace bw64 {
+  namespace simd {
+
+    /// @brief Instruction sets for which kernels are available, in order of
+    /// preference
+    enum class Isa { scalar, sse2, avx2, avx512 };
+
+    /// @brief Determine the best instruction set supported by the CPU and OS
+    inline Isa detectIsa() {
+#if defined(BW64_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+      __builtin_cpu_init();
+#ifdef BW64_SIMD_AVX512
+      if (__builtin_cpu_supports("avx512f") &&
+          __builtin_cpu_supports("avx512bw"))
+        return Isa::avx512;
+#endif
+      if (__builtin_cpu_supports("avx2")) return Isa::avx2;
+      if (__builtin_cpu_supports("sse2")) return Isa::sse2;
+      return Isa::scalar;
+#elif defined(BW64_SIMD_X86) && defined(_MSC_VER)
+      int info[4];
+      __cpuid(info, 0);
+      const int maxLeaf = info[0];
+      __cpuid(info, 1);
+      const bool sse2 = (info[3] & (1 << 26)) != 0;
+      const bool osxsave = (info[2] & (1 << 27)) != 0;
+      const bool avx = (info[2] & (1 << 28)) != 0;
+      // the OS must save the YMM (and for AVX-512, ZMM and mask) registers
+      const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+      const bool avxState = (xcr0 & 0x6) == 0x6;
+      const bool avx512State = (xcr0 & 0xe6) == 0xe6;
+
+      bool avx2 = false;
+      bool avx512 = false;
+      if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = avx && avxState && (info[1] & (1 << 5)) != 0;
+        avx512 = avx2 && avx512State && (info[1] & (1 << 16)) != 0 &&
+                 (info[1] & (1 << 30)) != 0;
+      }
+#ifdef BW64_SIMD_AVX512
+      if (avx512) return Isa::avx512;
+#endif
+      if (avx2) return Isa::avx2;
+      if (sse2) return Isa::sse2;
+      return Isa::scalar;
+#else
+      return Isa::scalar;
+#endif
+    }
+
+    /// @brief Instruction set used by default; detected once, on first use
+    inline Isa activeIsa() {
+      static const Isa isa = detectIsa();
+      return isa;
+    }
+
+    /// factor to convert integer samples with the given number of bits to
+    /// floating point; the same as in utils::decode
+    template <typename T, int bits>
+    T inverseScale() {
+      return T{1} / static_cast<T>(static_cast<uint32_t>(1) << (bits - 1));
+    }
+
+#ifdef BW64_SIMD_X86
+    /// unaligned 32 bit load
+    inline int32_t load32(const char* buffer) {
+      int32_t value;
+      std::memcpy(&value, buffer, sizeof(value));
+      return value;
+    }
+
+    /// unaligned 128 bit load
+    BW64_SIMD_TARGET("sse2")
+    inline __m128i load128(const char* buffer) {
+      return _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer));
+    }
+
+    // --- SSE2: 4 samples per vector ---
+
+    BW64_SIMD_TARGET("sse2")
+    inline void storeSse2(float* out, __m128i value, float scale) {
+      _mm_storeu_ps(out,
+                    _mm_mul_ps(_mm_cvtepi32_ps(value), _mm_set1_ps(scale)));
+    }
+
+    BW64_SIMD_TARGET("sse2")
+    inline void storeSse2(double* out, __m128i value, double scale) {
+      const __m128d scaleVec = _mm_set1_pd(scale);
+      const __m128i high = _mm_unpackhi_epi64(value, value);
+      _mm_storeu_pd(out, _mm_mul_pd(_mm_cvtepi32_pd(value), scaleVec));
+      _mm_storeu_pd(out + 2, _mm_mul_pd(_mm_cvtepi32_pd(high), scaleVec));
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("sse2")
+    uint64_t decode16Sse2(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 16>();
+      uint64_t i = 0;
+      for (; i + 8 <= n; i += 8) {
+        const __m128i v = load128(in + 2 * i);
+        // unpacking a vector with itself puts each sample in the high half of
+        // a 32 bit lane; shift it down to sign-extend
+        storeSse2(out + i, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), scale);
+        storeSse2(out + i + 4, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16),
+                  scale);
+      }
+      return i;
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("sse2")
+    uint64_t decode24Sse2(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 24>();
+      uint64_t i = 0;
+      // the last load reads one byte past the fourth sample
+      for (; i + 5 <= n; i += 4) {
+        const char* p = in + 3 * i;
+        const __m128i v = _mm_setr_epi32(load32(p), load32(p + 3),
+                                         load32(p + 6), load32(p + 9));
+        storeSse2(out + i, _mm_srai_epi32(_mm_slli_epi32(v, 8), 8), scale);
+      }
+      return i;
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("sse2")
+    uint64_t decode32Sse2(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 32>();
+      uint64_t i = 0;
+      for (; i + 4 <= n; i += 4) storeSse2(out + i, load128(in + 4 * i), scale);
+      return i;
+    }
+
+    // --- AVX2: 8 samples per vector ---
+
+    BW64_SIMD_TARGET("avx2")
+    inline void storeAvx2(float* out, __m256i value, float scale) {
+      _mm256_storeu_ps(out, _mm256_mul_ps(_mm256_cvtepi32_ps(value),
+                                          _mm256_set1_ps(scale)));
+    }
+
+    BW64_SIMD_TARGET("avx2")
+    inline void storeAvx2(double* out, __m256i value, double scale) {
+      const __m256d scaleVec = _mm256_set1_pd(scale);
+      const __m128i low = _mm256_castsi256_si128(value);
+      const __m128i high = _mm256_extracti128_si256(value, 1);
+      _mm256_storeu_pd(out, _mm256_mul_pd(_mm256_cvtepi32_pd(low), scaleVec));
+      _mm256_storeu_pd(out + 4,
+                       _mm256_mul_pd(_mm256_cvtepi32_pd(high), scaleVec));
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("avx2")
+    uint64_t decode16Avx2(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 16>();
+      uint64_t i = 0;
+      for (; i + 8 <= n; i += 8)
+        storeAvx2(out + i, _mm256_cvtepi16_epi32(load128(in + 2 * i)), scale);
+      return i;
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("avx2")
+    uint64_t decode24Avx2(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 24>();
+      // move each 3 byte sample into the high bytes of a 32 bit lane
+      const __m256i shuffle = _mm256_setr_epi8(
+          -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,  //
+          -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+      uint64_t i = 0;
+      // each half loads 16 bytes for 12 bytes of samples, so the second load
+      // reads 4 bytes past the eighth sample
+      for (; i + 10 <= n; i += 8) {
+        const char* p = in + 3 * i;
+        __m256i v = _mm256_castsi128_si256(load128(p));
+        v = _mm256_inserti128_si256(v, load128(p + 12), 1);
+        v = _mm256_shuffle_epi8(v, shuffle);
+        storeAvx2(out + i, _mm256_srai_epi32(v, 8), scale);
+      }
+      return i;
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("avx2")
+    uint64_t decode32Avx2(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 32>();
+      uint64_t i = 0;
+      for (; i + 8 <= n; i += 8) {
+        const __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 4 * i));
+        storeAvx2(out + i, v, scale);
+      }
+      return i;
+    }
+
+#ifdef BW64_SIMD_AVX512
+    // --- AVX-512: 16 samples per vector ---
+
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    inline void storeAvx512(float* out, __m512i value, float scale) {
+      _mm512_storeu_ps(out, _mm512_mul_ps(_mm512_cvtepi32_ps(value),
+                                          _mm512_set1_ps(scale)));
+    }
+
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    inline void storeAvx512(double* out, __m512i value, double scale) {
+      const __m512d scaleVec = _mm512_set1_pd(scale);
+      const __m256i low = _mm512_castsi512_si256(value);
+      const __m256i high = _mm512_extracti64x4_epi64(value, 1);
+      _mm512_storeu_pd(out, _mm512_mul_pd(_mm512_cvtepi32_pd(low), scaleVec));
+      _mm512_storeu_pd(out + 8,
+                       _mm512_mul_pd(_mm512_cvtepi32_pd(high), scaleVec));
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    uint64_t decode16Avx512(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 16>();
+      uint64_t i = 0;
+      for (; i + 16 <= n; i += 16) {
+        const __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+        storeAvx512(out + i, _mm512_cvtepi16_epi32(v), scale);
+      }
+      return i;
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    uint64_t decode24Avx512(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 24>();
+      // same per-lane shuffle as for AVX2
+      const __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(
+          -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11));
+      uint64_t i = 0;
+      // the last load reads 4 bytes past the sixteenth sample
+      for (; i + 18 <= n; i += 16) {
+        const char* p = in + 3 * i;
+        __m512i v = _mm512_castsi128_si512(load128(p));
+        v = _mm512_inserti32x4(v, load128(p + 12), 1);
+        v = _mm512_inserti32x4(v, load128(p + 24), 2);
+        v = _mm512_inserti32x4(v, load128(p + 36), 3);
+        v = _mm512_shuffle_epi8(v, shuffle);
+        storeAvx512(out + i, _mm512_srai_epi32(v, 8), scale);
+      }
+      return i;
+    }
+
+    template <typename T>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    uint64_t decode32Avx512(const char* in, T* out, uint64_t n) {
+      const T scale = inverseScale<T, 32>();
+      uint64_t i = 0;
+      for (; i + 16 <= n; i += 16)
+        storeAvx512(out + i, _mm512_loadu_si512(in + 4 * i), scale);
+      return i;
+    }
+#endif
+#endif
+
+#ifdef BW64_SIMD_X86
+    // --- encoding ---
+    //
+    // Samples are scaled, clamped to the integer range and rounded with the
+    // current rounding mode, which matches the comparisons and std::lrint in
+    // utils::encode. As there, 32 bit samples are processed as doubles. NaNs
+    // are encoded as 0.
+
+    /// largest integer sample value for a bit depth
+    template <typename T, int bits>
+    T maxSample() {
+      return static_cast<T>((static_cast<uint32_t>(1) << (bits - 1)) - 1);
+    }
+
+    /// smallest integer sample value for a bit depth
+    template <typename T, int bits>
+    T minSample() {
+      return -static_cast<T>(static_cast<uint32_t>(1) << (bits - 1));
+    }
+
+    // --- SSE2: 4 samples per vector ---
+
+    template <int bits>
+    BW64_SIMD_TARGET("sse2")
+    __m128i roundSse2(__m128 v) {
+      v = _mm_mul_ps(v, _mm_set1_ps(-minSample<float, bits>()));
+      v = _mm_and_ps(v, _mm_cmpord_ps(v, v));
+      v = _mm_max_ps(v, _mm_set1_ps(minSample<float, bits>()));
+      v = _mm_min_ps(v, _mm_set1_ps(maxSample<float, bits>()));
+      return _mm_cvtps_epi32(v);
+    }
+
+    /// round 2 samples, into the low half of the result
+    template <int bits>
+    BW64_SIMD_TARGET("sse2")
+    __m128i roundSse2(__m128d v) {
+      v = _mm_mul_pd(v, _mm_set1_pd(-minSample<double, bits>()));
+      v = _mm_and_pd(v, _mm_cmpord_pd(v, v));
+      v = _mm_max_pd(v, _mm_set1_pd(minSample<double, bits>()));
+      v = _mm_min_pd(v, _mm_set1_pd(maxSample<double, bits>()));
+      return _mm_cvtpd_epi32(v);
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("sse2")
+    __m128i loadIntSse2(const float* in) {
+      const __m128 v = _mm_loadu_ps(in);
+      if (bits != 32) return roundSse2<bits>(v);
+      return _mm_unpacklo_epi64(
+          roundSse2<bits>(_mm_cvtps_pd(v)),
+          roundSse2<bits>(_mm_cvtps_pd(_mm_movehl_ps(v, v))));
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("sse2")
+    __m128i loadIntSse2(const double* in) {
+      return _mm_unpacklo_epi64(roundSse2<bits>(_mm_loadu_pd(in)),
+                                roundSse2<bits>(_mm_loadu_pd(in + 2)));
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("sse2")
+    void storePcmSse2(char* out, __m128i v) {
+      __m128i* outVec = reinterpret_cast<__m128i*>(out);
+      if (bits == 16) {
+        _mm_storel_epi64(outVec, _mm_packs_epi32(v, v));
+      } else if (bits == 24) {
+        // pack each pair of samples into the low 48 bits of a 64 bit lane
+        const __m128i low = _mm_set1_epi64x(0xffffffll);
+        const __m128i high = _mm_set1_epi64x(0xffffff000000ll);
+        const __m128i shifted = _mm_srli_epi64(v, 8);
+        __m128i packed = _mm_or_si128(_mm_and_si128(v, low),
+                                      _mm_and_si128(shifted, high));
+        // then move the upper 48 bits down to follow the lower 48 bits
+        const __m128i upper = _mm_unpackhi_epi64(_mm_setzero_si128(), packed);
+        packed = _mm_or_si128(_mm_move_epi64(packed), _mm_srli_si128(upper, 2));
+        _mm_storel_epi64(outVec, packed);
+        const int32_t last = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+        std::memcpy(out + 8, &last, sizeof(last));
+      } else {
+        _mm_storeu_si128(outVec, v);
+      }
+    }
+
+    template <int bits, typename T>
+    BW64_SIMD_TARGET("sse2")
+    uint64_t encodeSse2(const T* in, char* out, uint64_t n) {
+      uint64_t i = 0;
+      for (; i + 4 <= n; i += 4)
+        storePcmSse2<bits>(out + i * (bits / 8), loadIntSse2<bits>(in + i));
+      return i;
+    }
+
+    // --- AVX2: 8 samples per vector ---
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx2")
+    __m256i roundAvx2(__m256 v) {
+      v = _mm256_mul_ps(v, _mm256_set1_ps(-minSample<float, bits>()));
+      v = _mm256_and_ps(v, _mm256_cmp_ps(v, v, _CMP_ORD_Q));
+      v = _mm256_max_ps(v, _mm256_set1_ps(minSample<float, bits>()));
+      v = _mm256_min_ps(v, _mm256_set1_ps(maxSample<float, bits>()));
+      return _mm256_cvtps_epi32(v);
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx2")
+    __m128i roundAvx2(__m256d v) {
+      v = _mm256_mul_pd(v, _mm256_set1_pd(-minSample<double, bits>()));
+      v = _mm256_and_pd(v, _mm256_cmp_pd(v, v, _CMP_ORD_Q));
+      v = _mm256_max_pd(v, _mm256_set1_pd(minSample<double, bits>()));
+      v = _mm256_min_pd(v, _mm256_set1_pd(maxSample<double, bits>()));
+      return _mm256_cvtpd_epi32(v);
+    }
+
+    BW64_SIMD_TARGET("avx2")
+    inline __m256i combineAvx2(__m128i low, __m128i high) {
+      return _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx2")
+    __m256i loadIntAvx2(const float* in) {
+      if (bits != 32) return roundAvx2<bits>(_mm256_loadu_ps(in));
+      const __m128 low = _mm_loadu_ps(in);
+      const __m128 high = _mm_loadu_ps(in + 4);
+      return combineAvx2(roundAvx2<bits>(_mm256_cvtps_pd(low)),
+                         roundAvx2<bits>(_mm256_cvtps_pd(high)));
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx2")
+    __m256i loadIntAvx2(const double* in) {
+      return combineAvx2(roundAvx2<bits>(_mm256_loadu_pd(in)),
+                         roundAvx2<bits>(_mm256_loadu_pd(in + 4)));
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx2")
+    void storePcmAvx2(char* out, __m256i v) {
+      if (bits == 16) {
+        const __m128i packed = _mm_packs_epi32(
+            _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+      } else if (bits == 24) {
+        // pack the 3 low bytes of each sample into the first 12 bytes of each
+        // half, then write both halves; the second overwrites the 4 spare
+        // bytes of the first, and writes 4 spare bytes past the end
+        const __m256i shuffle = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,  //
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        v = _mm256_shuffle_epi8(v, shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                         _mm256_castsi256_si128(v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 12),
+                         _mm256_extracti128_si256(v, 1));
+      } else {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+      }
+    }
+
+    template <int bits, typename T>
+    BW64_SIMD_TARGET("avx2")
+    uint64_t encodeAvx2(const T* in, char* out, uint64_t n) {
+      // leave room for the spare bytes written by 24 bit stores
+      const uint64_t minRemaining = bits == 24 ? 10 : 8;
+      uint64_t i = 0;
+      for (; i + minRemaining <= n; i += 8)
+        storePcmAvx2<bits>(out + i * (bits / 8), loadIntAvx2<bits>(in + i));
+      return i;
+    }
+
+#ifdef BW64_SIMD_AVX512
+    // --- AVX-512: 16 samples per vector ---
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    __m512i roundAvx512(__m512 v) {
+      v = _mm512_mul_ps(v, _mm512_set1_ps(-minSample<float, bits>()));
+      v = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(v, v, _CMP_ORD_Q), v);
+      v = _mm512_max_ps(v, _mm512_set1_ps(minSample<float, bits>()));
+      v = _mm512_min_ps(v, _mm512_set1_ps(maxSample<float, bits>()));
+      return _mm512_cvtps_epi32(v);
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    __m256i roundAvx512(__m512d v) {
+      v = _mm512_mul_pd(v, _mm512_set1_pd(-minSample<double, bits>()));
+      v = _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(v, v, _CMP_ORD_Q), v);
+      v = _mm512_max_pd(v, _mm512_set1_pd(minSample<double, bits>()));
+      v = _mm512_min_pd(v, _mm512_set1_pd(maxSample<double, bits>()));
+      return _mm512_cvtpd_epi32(v);
+    }
+
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    inline __m512i combineAvx512(__m256i low, __m256i high) {
+      return _mm512_inserti64x4(_mm512_castsi256_si512(low), high, 1);
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    __m512i loadIntAvx512(const float* in) {
+      if (bits != 32) return roundAvx512<bits>(_mm512_loadu_ps(in));
+      const __m256 low = _mm256_loadu_ps(in);
+      const __m256 high = _mm256_loadu_ps(in + 8);
+      return combineAvx512(roundAvx512<bits>(_mm512_cvtps_pd(low)),
+                           roundAvx512<bits>(_mm512_cvtps_pd(high)));
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    __m512i loadIntAvx512(const double* in) {
+      return combineAvx512(roundAvx512<bits>(_mm512_loadu_pd(in)),
+                           roundAvx512<bits>(_mm512_loadu_pd(in + 8)));
+    }
+
+    template <int bits>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    void storePcmAvx512(char* out, __m512i v) {
+      if (bits == 16) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                            _mm512_cvtsepi32_epi16(v));
+      } else if (bits == 24) {
+        // pack the 3 low bytes of each sample into 12 bytes per 128 bit lane,
+        // then move the used 32 bit words together
+        const __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+        const __m512i compact = _mm512_setr_epi32(0, 1, 2, 4, 5, 6, 8, 9, 10,
+                                                  12, 13, 14, 0, 0, 0, 0);
+        v = _mm512_permutexvar_epi32(compact, _mm512_shuffle_epi8(v, shuffle));
+        _mm512_mask_storeu_epi32(out, 0x0fff, v);
+      } else {
+        _mm512_storeu_si512(out, v);
+      }
+    }
+
+    template <int bits, typename T>
+    BW64_SIMD_TARGET("avx512f,avx512bw")
+    uint64_t encodeAvx512(const T* in, char* out, uint64_t n) {
+      uint64_t i = 0;
+      for (; i + 16 <= n; i += 16)
+        storePcmAvx512<bits>(out + i * (bits / 8), loadIntAvx512<bits>(in + i));
+      return i;
+    }
+#endif
+#endif
+
+    /**
+     * @brief Decode PCM samples to floating point using vector instructions
+     *
+     * @param inBuffer        PCM samples
+     * @param outBuffer       buffer for numberOfSamples decoded samples
+     * @param numberOfSamples number of samples in inBuffer
+     * @param bitsPerSample   bits per PCM sample
+     * @param isa             instruction set to use; must be supported
+     *
+     * @returns number of samples decoded, starting from the first; the rest
+     * must be decoded with utils::decodePcmSamplesScalar
+     */
+    template <typename T>
+    uint64_t decodePcmSamples(const char* inBuffer, T* outBuffer,
+                              uint64_t numberOfSamples, uint16_t bitsPerSample,
+                              Isa isa = activeIsa()) {
+#ifdef BW64_SIMD_X86
+#ifdef BW64_SIMD_AVX512
+      if (isa >= Isa::avx512) {
+        if (bitsPerSample == 16)
+          return decode16Avx512(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 24)
+          return decode24Avx512(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 32)
+          return decode32Avx512(inBuffer, outBuffer, numberOfSamples);
+      }
+#endif
+      if (isa >= Isa::avx2) {
+        if (bitsPerSample == 16)
+          return decode16Avx2(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 24)
+          return decode24Avx2(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 32)
+          return decode32Avx2(inBuffer, outBuffer, numberOfSamples);
+      }
+      if (isa >= Isa::sse2) {
+        if (bitsPerSample == 16)
+          return decode16Sse2(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 24)
+          return decode24Sse2(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 32)
+          return decode32Sse2(inBuffer, outBuffer, numberOfSamples);
+      }
+#else
+      (void)inBuffer;
+      (void)outBuffer;
+      (void)numberOfSamples;
+      (void)bitsPerSample;
+      (void)isa;
+#endif
+      return 0;
+    }
+
+    /**
+     * @brief Encode floating point samples to PCM using vector instructions
+     *
+     * @param inBuffer        samples to encode
+     * @param outBuffer       buffer for numberOfSamples PCM samples
+     * @param numberOfSamples number of samples in inBuffer
+     * @param bitsPerSample   bits per PCM sample
+     * @param isa             instruction set to use; must be supported
+     *
+     * @returns number of samples encoded, starting from the first; the rest
+     * must be encoded with utils::encodePcmSamplesScalar
+     */
+    template <typename T>
+    uint64_t encodePcmSamples(const T* inBuffer, char* outBuffer,
+                              uint64_t numberOfSamples, uint16_t bitsPerSample,
+                              Isa isa = activeIsa()) {
+#ifdef BW64_SIMD_X86
+#ifdef BW64_SIMD_AVX512
+      if (isa >= Isa::avx512) {
+        if (bitsPerSample == 16)
+          return encodeAvx512<16>(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 24)
+          return encodeAvx512<24>(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 32)
+          return encodeAvx512<32>(inBuffer, outBuffer, numberOfSamples);
+      }
+#endif
+      if (isa >= Isa::avx2) {
+        if (bitsPerSample == 16)
+          return encodeAvx2<16>(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 24)
+          return encodeAvx2<24>(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 32)
+          return encodeAvx2<32>(inBuffer, outBuffer, numberOfSamples);
+      }
+      if (isa >= Isa::sse2) {
+        if (bitsPerSample == 16)
+          return encodeSse2<16>(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 24)
+          return encodeSse2<24>(inBuffer, outBuffer, numberOfSamples);
+        if (bitsPerSample == 32)
+          return encodeSse2<32>(inBuffer, outBuffer, numberOfSamples);
+      }
+#else
+      (void)inBuffer;
+      (void)outBuffer;
+      (void)numberOfSamples;
+      (void)bitsPerSample;
+      (void)isa;
+#endif
+      return 0;
+    }
+
+  }  // namespace simd
+}  // namespace bw64
@@ -4,6 +4,7 @@
  * Collection of helper functions.
  */
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 #include <stdexcept>
@@ -12,8 +13,32 @@
 #include <type_traits>
 #include <stdint.h>
 #include "chunks.hpp"
+#include "simd.hpp"
 
 namespace bw64 {
+
+  /**
+   * @brief Packed 24 bit integer sample
+   *
+   * The three bytes are stored little endian, in the same format as samples in
+   * a 24 bit PCM file.
+   */
+  struct Int24 {
+    char bytes[3];
+  };
+
+  /**
+   * @brief Placement of samples within integers with a different bit depth
+   */
+  enum class Justification {
+    /// the most significant bits line up, so full scale in the file is full
+    /// scale in the integer type; converting to fewer bits truncates
+    left,
+    /// the least significant bits line up, so sample values are unchanged;
+    /// the integer type must be large enough to hold the samples
+    right
+  };
+
   namespace utils {
 
     /// @brief Convert char array chunkIds to uint32_t
@@ -70,13 +95,21 @@ namespace bw64 {
       }
     }
 
+    /// @brief Write size zero bytes to a stream, in blocks
+    inline void writeZeros(std::ostream& stream, uint64_t size) {
+      static const char zeros[4096] = {};
+      while (size) {
+        const uint64_t count = (std::min)(size, uint64_t{sizeof(zeros)});
+        stream.write(zeros, static_cast<std::streamsize>(count));
+        size -= count;
+      }
+    }
+
     inline void writeChunkPlaceholder(std::ostream& stream, uint32_t id,
                                       uint32_t size) {
       utils::writeValue(stream, id);
       utils::writeValue(stream, size);
-      for (unsigned int i = 0; i < size; ++i) {
-        writeValue(stream, '\0');
-      }
+      writeZeros(stream, size);
     }
 
     /// @brief Limit sample to [-1,+1]
@@ -98,6 +131,14 @@ namespace bw64 {
       return static_cast<T>(static_cast<uint32_t>(1) << (bits - 1));
     }
 
+    /// encode the low bytes of one integer sample to PCM
+    template <int bytes, typename IntT>
+    void encodeInt(IntT value, char* buffer) {
+      static_assert(sizeof(IntT) >= bytes, "IntT must be larger than bytes");
+      for (size_t i = 0; i < bytes; i++)
+        buffer[i] = (value >> (8 * i)) & 0xff;
+    }
+
     /// encode one sample to PCM
     template <int bytes, typename IntT, typename T,
               typename std::enable_if<std::is_floating_point<T>::value,
@@ -122,17 +163,13 @@ namespace bw64 {
       else
         value_int = static_cast<IntT>(std::lrint(value));
 
-      for (size_t i = 0; i < bytes; i++)
-        buffer[i] = (value_int >> (8 * i)) & 0xff;
+      encodeInt<bytes>(value_int, buffer);
     }
 
-    /// decode one sample from PCM
-    template <int bytes, typename IntT, typename T,
-              typename std::enable_if<std::is_floating_point<T>::value,
-                                      int>::type = 0>
-    T decode(const char* buffer) {
+    /// decode one sample from PCM to a sign-extended integer
+    template <int bytes, typename IntT>
+    IntT decodeInt(const char* buffer) {
       static_assert(sizeof(IntT) >= bytes, "IntT must be larger than bytes");
-      constexpr int bits = bytes * 8;
 
       // when converting from a char to an int, sign extension occurs and the
       // high bit is replicated to the high bytes
@@ -148,16 +185,127 @@ namespace bw64 {
         value |= (static_cast<IntT>(buffer[i]) & 0xff) << (i * 8);
       value |= static_cast<IntT>(buffer[bytes - 1]) << ((bytes - 1) * 8);
 
+      return value;
+    }
+
+    /// decode one sample from PCM
+    template <int bytes, typename IntT, typename T,
+              typename std::enable_if<std::is_floating_point<T>::value,
+                                      int>::type = 0>
+    T decode(const char* buffer) {
+      constexpr int bits = bytes * 8;
+
+      IntT value = decodeInt<bytes, IntT>(buffer);
+
       constexpr T scale_inv = T{1} / scaleFactor<T, bits>();
 
       return clipSample(scale_inv * value);
     }
 
-    /// @brief Decode (integer) PCM samples as float from char array
+    /// number of bits in the integer sample types supported for reading and
+    /// writing without conversion to floating point
+    template <typename T>
+    struct IntSampleBits : std::integral_constant<int, 0> {};
+    template <>
+    struct IntSampleBits<int16_t> : std::integral_constant<int, 16> {};
+    template <>
+    struct IntSampleBits<Int24> : std::integral_constant<int, 24> {};
+    template <>
+    struct IntSampleBits<int32_t> : std::integral_constant<int, 32> {};
+
+    /// is T one of the integer sample types: int16_t, Int24 or int32_t
+    template <typename T>
+    struct IsIntSample
+        : std::integral_constant<
+              bool, IntSampleBits<typename std::remove_const<T>::type>::value !=
+                        0> {};
+
+    /// shift a sign-extended sample left (shift > 0) or right (shift < 0)
+    inline int32_t shiftSample(int32_t value, int shift) {
+      // shift as unsigned to avoid undefined behaviour with negative values
+      if (shift >= 0)
+        return static_cast<int32_t>(static_cast<uint32_t>(value) << shift);
+      else
+        return value >> -shift;
+    }
+
+    /// store the low bits of a sample into an integer sample type
+    inline void storeIntSample(int32_t value, int16_t* out) {
+      *out = static_cast<int16_t>(value);
+    }
+    inline void storeIntSample(int32_t value, Int24* out) {
+      for (size_t i = 0; i < 3; i++) out->bytes[i] = (value >> (8 * i)) & 0xff;
+    }
+    inline void storeIntSample(int32_t value, int32_t* out) { *out = value; }
+
+    /// load an integer sample type as a sign-extended int32_t
+    inline int32_t loadIntSample(const int16_t* in) { return *in; }
+    inline int32_t loadIntSample(const Int24* in) {
+      return decodeInt<3, int32_t>(in->bytes);
+    }
+    inline int32_t loadIntSample(const int32_t* in) { return *in; }
+
+    /// @brief Number of bits to shift samples by when converting between
+    /// bitsPerSample and IntT
+    ///
+    /// Positive values are left shifts from the file to IntT. Throws if the
+    /// conversion is not possible.
+    template <typename IntT>
+    int intSampleShift(uint16_t bitsPerSample, Justification justification) {
+      constexpr int intBits = IntSampleBits<IntT>::value;
+      if (bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32) {
+        std::stringstream errorString;
+        errorString << "unsupported number of bits: " << bitsPerSample;
+        throw std::runtime_error(errorString.str());
+      }
+      if (justification == Justification::left) return intBits - bitsPerSample;
+
+      if (bitsPerSample > intBits) {
+        std::stringstream errorString;
+        errorString << bitsPerSample << " bit samples do not fit into "
+                    << intBits << " bit integers with right justification";
+        throw std::runtime_error(errorString.str());
+      }
+      return 0;
+    }
+
+    /// @brief Decode (integer) PCM samples as integers from char array
+    ///
+    /// Samples are only shifted according to justification, with no scaling
+    /// or clipping.
+    template <typename IntT,
+              typename std::enable_if<IsIntSample<IntT>::value, int>::type = 0>
+    void decodePcmSamples(const char* inBuffer, IntT* outBuffer,
+                          uint64_t numberOfSamples, uint16_t bitsPerSample,
+                          Justification justification = Justification::left) {
+      const int shift = intSampleShift<IntT>(bitsPerSample, justification);
+      if (bitsPerSample == 16) {
+        for (uint64_t i = 0; i < numberOfSamples; ++i) {
+          int32_t value = decodeInt<2, int32_t>(inBuffer + i * 2);
+          storeIntSample(shiftSample(value, shift), outBuffer + i);
+        }
+      } else if (bitsPerSample == 24) {
+        for (uint64_t i = 0; i < numberOfSamples; ++i) {
+          int32_t value = decodeInt<3, int32_t>(inBuffer + i * 3);
+          storeIntSample(shiftSample(value, shift), outBuffer + i);
+        }
+      } else {
+        for (uint64_t i = 0; i < numberOfSamples; ++i) {
+          int32_t value = decodeInt<4, int32_t>(inBuffer + i * 4);
+          storeIntSample(shiftSample(value, shift), outBuffer + i);
+        }
+      }
+    }
+
+    /// @brief Decode (integer) PCM samples as float from char array, one at a
+    /// time
+    ///
+    /// This is the reference implementation for the kernels in simd.hpp.
     template <typename T, typename std::enable_if<
                               std::is_floating_point<T>::value, int>::type = 0>
-    void decodePcmSamples(const char* inBuffer, T* outBuffer,
-                          uint64_t numberOfSamples, uint16_t bitsPerSample) {
+    void decodePcmSamplesScalar(const char* inBuffer, T* outBuffer,
+                                uint64_t numberOfSamples,
+                                uint16_t bitsPerSample) {
       if (bitsPerSample == 16) {
         for (uint64_t i = 0; i < numberOfSamples; ++i) {
           outBuffer[i] = decode<2, int16_t, T>(inBuffer + i * 2);
@@ -177,11 +325,140 @@ namespace bw64 {
       }
     }
 
-    /// @brief Encode PCM samples from float array to char array
-    template <typename T,
-              typename = std::enable_if<std::is_floating_point<T>::value>>
-    void encodePcmSamples(const T* inBuffer, char* outBuffer,
+    /// @brief Decode (integer) PCM samples as float from char array
+    ///
+    /// Vector instructions are used if possible, giving the same results as
+    /// decodePcmSamplesScalar.
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    void decodePcmSamples(const char* inBuffer, T* outBuffer,
                           uint64_t numberOfSamples, uint16_t bitsPerSample) {
+      const uint64_t decoded = simd::decodePcmSamples(
+          inBuffer, outBuffer, numberOfSamples, bitsPerSample);
+      decodePcmSamplesScalar(inBuffer + decoded * (bitsPerSample / 8),
+                             outBuffer + decoded, numberOfSamples - decoded,
+                             bitsPerSample);
+    }
+
+    /// decode some channels of interleaved frames
+    template <int bytes, typename IntT, typename T>
+    void decodePcmChannels(const char* inBuffer, T* outBuffer,
+                           uint64_t numberOfFrames, uint16_t channels,
+                           const uint16_t* selected, uint16_t numSelected) {
+      const uint64_t frameSize = static_cast<uint64_t>(channels) * bytes;
+      for (uint64_t i = 0; i < numberOfFrames; ++i) {
+        const char* in = inBuffer + i * frameSize;
+        for (uint16_t c = 0; c < numSelected; ++c)
+          *outBuffer++ = decode<bytes, IntT, T>(in + selected[c] * bytes);
+      }
+    }
+
+    /// @brief Decode selected channels of interleaved (integer) PCM frames as
+    /// float
+    ///
+    /// Only the selected samples of each frame are read.
+    ///
+    /// @param inBuffer       interleaved PCM frames
+    /// @param outBuffer      buffer for `numberOfFrames * numSelected` samples,
+    /// interleaved in the order given by selected
+    /// @param numberOfFrames number of frames in inBuffer
+    /// @param channels       number of channels per frame in inBuffer
+    /// @param selected       indices of the channels to decode; these must be
+    /// less than channels, and may be repeated
+    /// @param numSelected    number of elements in selected
+    /// @param bitsPerSample  bits per PCM sample
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    void decodePcmChannels(const char* inBuffer, T* outBuffer,
+                           uint64_t numberOfFrames, uint16_t channels,
+                           const uint16_t* selected, uint16_t numSelected,
+                           uint16_t bitsPerSample) {
+      if (bitsPerSample == 16) {
+        decodePcmChannels<2, int16_t>(inBuffer, outBuffer, numberOfFrames,
+                                      channels, selected, numSelected);
+      } else if (bitsPerSample == 24) {
+        decodePcmChannels<3, int32_t>(inBuffer, outBuffer, numberOfFrames,
+                                      channels, selected, numSelected);
+      } else if (bitsPerSample == 32) {
+        decodePcmChannels<4, int32_t>(inBuffer, outBuffer, numberOfFrames,
+                                      channels, selected, numSelected);
+      } else {
+        std::stringstream errorString;
+        errorString << "unsupported number of bits: " << bitsPerSample;
+        throw std::runtime_error(errorString.str());
+      }
+    }
+
+    /// decode interleaved frames into channel buffers, one channel at a time
+    template <int bytes, typename IntT, typename T>
+    void decodePcmSamplesPlanar(const char* inBuffer, T* const* outBuffers,
+                                uint64_t outOffset, uint64_t numberOfFrames,
+                                uint16_t channels) {
+      const uint64_t frameSize = static_cast<uint64_t>(channels) * bytes;
+      for (uint16_t channel = 0; channel < channels; ++channel) {
+        const char* in = inBuffer + channel * bytes;
+        T* out = outBuffers[channel] + outOffset;
+        for (uint64_t i = 0; i < numberOfFrames; ++i)
+          out[i] = decode<bytes, IntT, T>(in + i * frameSize);
+      }
+    }
+
+    /// @brief Decode interleaved (integer) PCM frames as float into one
+    /// buffer per channel
+    ///
+    /// The frames are processed in blocks small enough to stay in cache while
+    /// each channel is written, so that the input is only read from memory
+    /// once however many channels there are.
+    ///
+    /// @param inBuffer       interleaved PCM frames
+    /// @param outBuffers     one buffer per channel
+    /// @param outOffset      index in each of outBuffers to write the first
+    /// frame to
+    /// @param numberOfFrames number of frames in inBuffer
+    /// @param channels       number of channels per frame
+    /// @param bitsPerSample  bits per PCM sample
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    void decodePcmSamplesPlanar(const char* inBuffer, T* const* outBuffers,
+                                uint64_t outOffset, uint64_t numberOfFrames,
+                                uint16_t channels, uint16_t bitsPerSample) {
+      if (bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32) {
+        std::stringstream errorString;
+        errorString << "unsupported number of bits: " << bitsPerSample;
+        throw std::runtime_error(errorString.str());
+      }
+      if (channels == 0) return;
+
+      // about 16k of input per block, but at least a cache line of output
+      const uint64_t frameSize =
+          static_cast<uint64_t>(channels) * (bitsPerSample / 8);
+      const uint64_t blockFrames =
+          (std::max)(uint64_t{16}, uint64_t{16384} / frameSize);
+
+      for (uint64_t start = 0; start < numberOfFrames; start += blockFrames) {
+        const uint64_t frames = (std::min)(blockFrames, numberOfFrames - start);
+        const char* in = inBuffer + start * frameSize;
+        if (bitsPerSample == 16)
+          decodePcmSamplesPlanar<2, int16_t>(in, outBuffers, outOffset + start,
+                                             frames, channels);
+        else if (bitsPerSample == 24)
+          decodePcmSamplesPlanar<3, int32_t>(in, outBuffers, outOffset + start,
+                                             frames, channels);
+        else
+          decodePcmSamplesPlanar<4, int32_t>(in, outBuffers, outOffset + start,
+                                             frames, channels);
+      }
+    }
+
+    /// @brief Encode PCM samples from float array to char array, one at a
+    /// time
+    ///
+    /// This is the reference implementation for the kernels in simd.hpp.
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    void encodePcmSamplesScalar(const T* inBuffer, char* outBuffer,
+                                uint64_t numberOfSamples,
+                                uint16_t bitsPerSample) {
       if (bitsPerSample == 16) {
         for (uint64_t i = 0; i < numberOfSamples; ++i) {
           encode<2, int16_t>(inBuffer[i], outBuffer + 2 * i);
@@ -203,6 +480,109 @@ namespace bw64 {
       }
     }
 
+    /// @brief Encode PCM samples from float array to char array
+    ///
+    /// Vector instructions are used if possible, giving the same results as
+    /// encodePcmSamplesScalar.
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    void encodePcmSamples(const T* inBuffer, char* outBuffer,
+                          uint64_t numberOfSamples, uint16_t bitsPerSample) {
+      const uint64_t encoded = simd::encodePcmSamples(
+          inBuffer, outBuffer, numberOfSamples, bitsPerSample);
+      encodePcmSamplesScalar(inBuffer + encoded,
+                             outBuffer + encoded * (bitsPerSample / 8),
+                             numberOfSamples - encoded, bitsPerSample);
+    }
+
+    /// encode channel buffers into interleaved frames, one channel at a time
+    template <int bytes, typename IntT, typename CalcT, typename T>
+    void encodePcmSamplesPlanar(const T* const* inBuffers, uint64_t inOffset,
+                                char* outBuffer, uint64_t numberOfFrames,
+                                uint16_t channels) {
+      const uint64_t frameSize = static_cast<uint64_t>(channels) * bytes;
+      for (uint16_t channel = 0; channel < channels; ++channel) {
+        const T* in = inBuffers[channel] + inOffset;
+        char* out = outBuffer + channel * bytes;
+        for (uint64_t i = 0; i < numberOfFrames; ++i)
+          encode<bytes, IntT>(static_cast<CalcT>(in[i]), out + i * frameSize);
+      }
+    }
+
+    /// @brief Encode PCM samples from one float array per channel into
+    /// interleaved frames
+    ///
+    /// As for decodePcmSamplesPlanar, the frames are processed in blocks
+    /// small enough to stay in cache while each channel is read.
+    ///
+    /// @param inBuffers      one buffer per channel
+    /// @param inOffset       index in each of inBuffers of the first frame
+    /// @param outBuffer      buffer for numberOfFrames interleaved PCM frames
+    /// @param numberOfFrames number of frames to encode
+    /// @param channels       number of channels per frame
+    /// @param bitsPerSample  bits per PCM sample
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    void encodePcmSamplesPlanar(const T* const* inBuffers, uint64_t inOffset,
+                                char* outBuffer, uint64_t numberOfFrames,
+                                uint16_t channels, uint16_t bitsPerSample) {
+      if (bitsPerSample != 16 && bitsPerSample != 24 && bitsPerSample != 32) {
+        std::stringstream errorString;
+        errorString << "unsupported number of bits: " << bitsPerSample;
+        throw std::runtime_error(errorString.str());
+      }
+      if (channels == 0) return;
+
+      const uint64_t frameSize =
+          static_cast<uint64_t>(channels) * (bitsPerSample / 8);
+      const uint64_t blockFrames =
+          (std::max)(uint64_t{16}, uint64_t{16384} / frameSize);
+
+      for (uint64_t start = 0; start < numberOfFrames; start += blockFrames) {
+        const uint64_t frames = (std::min)(blockFrames, numberOfFrames - start);
+        char* out = outBuffer + start * frameSize;
+        // work in doubles for 32 bit to avoid roundoff
+        if (bitsPerSample == 16)
+          encodePcmSamplesPlanar<2, int16_t, T>(inBuffers, inOffset + start,
+                                                out, frames, channels);
+        else if (bitsPerSample == 24)
+          encodePcmSamplesPlanar<3, int32_t, T>(inBuffers, inOffset + start,
+                                                out, frames, channels);
+        else
+          encodePcmSamplesPlanar<4, int32_t, double>(
+              inBuffers, inOffset + start, out, frames, channels);
+      }
+    }
+
+    /// @brief Encode PCM samples from integer array to char array
+    ///
+    /// Samples are only shifted according to justification, with no scaling
+    /// or clipping; with Justification::right, samples outside of the range
+    /// of bitsPerSample wrap around.
+    template <typename IntT,
+              typename std::enable_if<IsIntSample<IntT>::value, int>::type = 0>
+    void encodePcmSamples(const IntT* inBuffer, char* outBuffer,
+                          uint64_t numberOfSamples, uint16_t bitsPerSample,
+                          Justification justification = Justification::left) {
+      const int shift = -intSampleShift<IntT>(bitsPerSample, justification);
+      if (bitsPerSample == 16) {
+        for (uint64_t i = 0; i < numberOfSamples; ++i) {
+          int32_t value = shiftSample(loadIntSample(inBuffer + i), shift);
+          encodeInt<2>(value, outBuffer + 2 * i);
+        }
+      } else if (bitsPerSample == 24) {
+        for (uint64_t i = 0; i < numberOfSamples; ++i) {
+          int32_t value = shiftSample(loadIntSample(inBuffer + i), shift);
+          encodeInt<3>(value, outBuffer + 3 * i);
+        }
+      } else {
+        for (uint64_t i = 0; i < numberOfSamples; ++i) {
+          int32_t value = shiftSample(loadIntSample(inBuffer + i), shift);
+          encodeInt<4>(value, outBuffer + 4 * i);
+        }
+      }
+    }
+
     /// check x against the maximum value that To can hold
     template <typename To, typename From>
     void checkUpper(From x) {
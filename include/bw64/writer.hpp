@@ -9,14 +9,33 @@
 #include <stdint.h>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include "chunks.hpp"
+#include "io.hpp"
+#include "io_uring.hpp"
 #include "utils.hpp"
 
 namespace bw64 {
 
   const uint32_t MAX_NUMBER_OF_UIDS = 1024;
 
+  /**
+   * @brief How a Bw64Writer writes sample data
+   */
+  enum class WriteMode {
+    /// write through a `std::ofstream`
+    stream,
+    /// write sample data with direct I/O (e.g. `O_DIRECT`), bypassing the
+    /// page cache, if supported by the platform and file system
+    ///
+    /// Samples are collected into aligned blocks (see
+    /// Bw64Writer::setWriteBufferSize()); the parts of the data chunk before
+    /// the first and after the last whole block are written through the
+    /// stream.
+    direct
+  };
+
   /**
    * @brief BW64 Writer class
    *
@@ -44,18 +63,38 @@ namespace bw64 {
      * the `additionalChunks`. They will be written directly after opening the
      * file.
      *
+     * WriteMode::direct avoids filling the page cache when writing large
+     * files.
+     *
      * @note For convenience, you might consider using the `writeFile` helper
      * function.
      */
     Bw64Writer(const char* filename, uint16_t channels, uint32_t sampleRate,
                uint16_t bitDepth,
-               std::vector<std::shared_ptr<Chunk>> additionalChunks) {
+               std::vector<std::shared_ptr<Chunk>> additionalChunks,
+               WriteMode mode = WriteMode::stream)
+        : mode_(mode), filename_(filename) {
       fileStream_.open(filename, std::fstream::out | std::fstream::binary);
       if (!fileStream_.is_open()) {
         std::stringstream errorString;
         errorString << "Could not open file: " << filename;
         throw std::runtime_error(errorString.str());
       }
+      if (mode_ == WriteMode::direct) {
+        dataFile_.open(filename, utils::FileAccess::write, true);
+        setWriteBufferSize(uint64_t{1} << 20);
+      }
+#ifdef BW64_IO_URING
+      // write sample data through a separate handle, if io_uring is
+      // supported
+      if (mode_ == WriteMode::stream) {
+        ioUring_.reset(new utils::IoUring());
+        if (ioUring_->isOpen())
+          dataFile_.open(filename, utils::FileAccess::write);
+        else
+          ioUring_.reset();
+      }
+#endif
       writeRiffHeader();
       // 28 byte ds64 header + 12 byte entry for axml
       writeChunkPlaceholder(utils::fourCC("JUNK"), 40u);
@@ -72,6 +111,14 @@ namespace bw64 {
       }
       auto dataChunk = std::make_shared<DataChunk>();
       writeChunk(dataChunk);
+
+      // cached for write()
+      formatChunk_ = findChunk<FormatInfoChunk>(utils::fourCC("fmt "));
+      dataChunk_ = findChunk<DataChunk>(utils::fourCC("data"));
+      dataHeaderIndex_ = chunkHeaderIndex_.at(utils::fourCC("data"));
+      channels_ = formatChunk_->channelCount();
+      bitDepth_ = formatChunk_->bitsPerSample();
+      blockAlignment_ = formatChunk_->blockAlignment();
     }
 
     /// finalise and close the file
@@ -86,15 +133,19 @@ namespace bw64 {
       if (!fileStream_.is_open()) return;
 
       try {
+        flushWriteBuffer();
         finalizeDataChunk();
         for (auto chunk : postDataChunks_) {
           writeChunk(chunk);
         }
         finalizeRiffChunk();
+        if (reservedSize_) releaseReservedStorage();
+        closeDataFile();
         fileStream_.close();
       } catch (...) {
         // ensure that if an exception is thrown the file is still closed, so
         // the destructor does not throw the same exception
+        closeDataFile();
         fileStream_.close();
         throw;
       }
@@ -108,17 +159,78 @@ namespace bw64 {
     /// handle exceptions
     ~Bw64Writer() { close(); }
 
+    /// @brief Get the mode used to write sample data
+    WriteMode writeMode() const { return mode_; }
+
+    /**
+     * @brief Set the size of the buffer used to combine writes
+     *
+     * Encoded samples are collected in a page-aligned buffer of this many
+     * bytes, which is written to the file when it is full and when closing,
+     * so that many small write() calls result in few large writes.
+     *
+     * Any samples already in the buffer are written first.
+     *
+     * @param size buffer size in bytes. In WriteMode::stream this defaults to
+     * 0, which writes samples immediately. In WriteMode::direct this is
+     * rounded up to a multiple of 4096 bytes, and defaults to 1MB.
+     */
+    void setWriteBufferSize(uint64_t size) {
+      flushWriteBuffer();
+      if (mode_ == WriteMode::direct)
+        size = (std::max)(utils::alignUp(size), utils::directIoAlignment);
+
+      if (size < writeBuffer_.size()) writeBuffer_.clear();
+      if (size) writeBuffer_.resize(size);
+      writeBufferSize_ = size;
+    }
+    /// @brief Get the size of the buffer used to combine writes
+    uint64_t writeBufferSize() const { return writeBufferSize_; }
+
+    /**
+     * @brief Reserve file storage for frames which are yet to be written
+     *
+     * Storage is allocated for the data chunk to hold this many more frames
+     * (with `fallocate()`, `F_PREALLOCATE` or `FileAllocationInfo`), without
+     * changing the file size. This reduces fragmentation when several long
+     * files are written at once. Storage which is not used is released by
+     * close().
+     *
+     * This is only a hint: more or fewer frames may still be written. For an
+     * expected duration, pass the number of seconds multiplied by
+     * sampleRate().
+     *
+     * @returns true if storage was reserved, or false if this is not
+     * supported by the platform or file system
+     */
+    bool reserveFrames(uint64_t frames) {
+      if (!fileStream_.is_open())
+        throw std::runtime_error("can not reserve frames after closing");
+      const uint64_t dataEnd =
+          chunkHeaders_[dataHeaderIndex_].position + 8u + dataChunk_->size();
+      if (frames > (UINT64_MAX - dataEnd) / blockAlignment_)
+        throw std::runtime_error("overflow");
+      const uint64_t end = dataEnd + frames * blockAlignment_;
+      if (end <= reservedSize_) return true;
+
+      if (!dataFile_.isOpen())
+        dataFile_.open(filename_.c_str(), utils::FileAccess::write);
+      if (!dataFile_.allocate(end)) return false;
+      reservedSize_ = end;
+      return true;
+    }
+
     /// @brief Get format tag
-    uint16_t formatTag() const { return formatChunk()->formatTag(); };
+    uint16_t formatTag() const { return formatChunk_->formatTag(); };
     /// @brief Get number of channels
-    uint16_t channels() const { return formatChunk()->channelCount(); };
+    uint16_t channels() const { return channels_; };
     /// @brief Get sample rate
-    uint32_t sampleRate() const { return formatChunk()->sampleRate(); };
+    uint32_t sampleRate() const { return formatChunk_->sampleRate(); };
     /// @brief Get bit depth
-    uint16_t bitDepth() const { return formatChunk()->bitsPerSample(); };
+    uint16_t bitDepth() const { return bitDepth_; };
     /// @brief Get number of frames
     uint64_t framesWritten() const {
-      return dataChunk()->size() / formatChunk()->blockAlignment();
+      return dataChunk_->size() / blockAlignment_;
     }
 
     template <typename ChunkType>
@@ -149,19 +261,17 @@ namespace bw64 {
     }
 
     std::shared_ptr<DataSize64Chunk> ds64Chunk() const {
-      return chunk<DataSize64Chunk>(chunks_, utils::fourCC("ds64"));
+      return findChunk<DataSize64Chunk>(utils::fourCC("ds64"));
     }
     std::shared_ptr<FormatInfoChunk> formatChunk() const {
-      return chunk<FormatInfoChunk>(chunks_, utils::fourCC("fmt "));
-    }
-    std::shared_ptr<DataChunk> dataChunk() const {
-      return chunk<DataChunk>(chunks_, utils::fourCC("data"));
+      return formatChunk_;
     }
+    std::shared_ptr<DataChunk> dataChunk() const { return dataChunk_; }
     std::shared_ptr<ChnaChunk> chnaChunk() const {
-      return chunk<ChnaChunk>(chunks_, utils::fourCC("chna"));
+      return findChunk<ChnaChunk>(utils::fourCC("chna"));
     }
     std::shared_ptr<AxmlChunk> axmlChunk() const {
-      return chunk<AxmlChunk>(chunks_, utils::fourCC("axml"));
+      return findChunk<AxmlChunk>(utils::fourCC("axml"));
     }
 
     /// @brief Check if file is bigger than 4GB and therefore a BW64 file
@@ -243,7 +353,7 @@ namespace bw64 {
       auto ds64Chunk = std::make_shared<DataSize64Chunk>();
       ds64Chunk->bw64Size(riffChunkSize());
       // write data size even if it's not too big
-      ds64Chunk->dataSize(dataChunk()->size());
+      ds64Chunk->dataSize(dataChunk_->size());
 
       for (auto& header : chunkHeaders_)
         if (header.size > UINT32_MAX)
@@ -253,7 +363,7 @@ namespace bw64 {
     }
 
     void finalizeDataChunk() {
-      if (dataChunk()->size() % 2 == 1) {
+      if (dataChunk_->size() % 2 == 1) {
         utils::writeValue(fileStream_, '\0');
       }
       auto last_position = fileStream_.tellp();
@@ -268,17 +378,20 @@ namespace bw64 {
     void writeChunk(std::shared_ptr<ChunkType> chunk) {
       if (chunk) {
         uint64_t position = fileStream_.tellp();
-        chunkHeaders_.push_back(
-            ChunkHeader(chunk->id(), chunk->size(), position));
-        utils::writeChunk<ChunkType>(fileStream_, chunk,
-                                     chunkSizeForHeader(chunk->id()));
+        addChunkHeader(ChunkHeader(chunk->id(), chunk->size(), position));
+        // not chunkSizeForHeader(), which uses the first chunk with this id
+        const uint32_t sizeForHeader =
+            chunk->size() >= UINT32_MAX ? UINT32_MAX
+                                        : static_cast<uint32_t>(chunk->size());
+        utils::writeChunk<ChunkType>(fileStream_, chunk, sizeForHeader);
+        chunkIndex_.insert(std::make_pair(chunk->id(), chunks_.size()));
         chunks_.push_back(chunk);
       }
     }
 
     void writeChunkPlaceholder(uint32_t id, uint32_t size) {
       uint64_t position = fileStream_.tellp();
-      chunkHeaders_.push_back(ChunkHeader(id, size, position));
+      addChunkHeader(ChunkHeader(id, size, position));
       utils::writeChunkPlaceholder(fileStream_, id, size);
     }
 
@@ -306,12 +419,17 @@ namespace bw64 {
       fileStream_.seekp(header.position);
     }
 
+    /// add a header to chunkHeaders_; only the first with each id can be
+    /// found with chunkHeader()
+    void addChunkHeader(const ChunkHeader& header) {
+      chunkHeaderIndex_.insert(std::make_pair(header.id, chunkHeaders_.size()));
+      chunkHeaders_.push_back(header);
+    }
+
     ChunkHeader& chunkHeader(uint32_t id) {
-      auto foundHeader = std::find_if(
-          chunkHeaders_.begin(), chunkHeaders_.end(),
-          [id](const ChunkHeader header) { return header.id == id; });
-      if (foundHeader != chunkHeaders_.end()) {
-        return *foundHeader;
+      auto index = chunkHeaderIndex_.find(id);
+      if (index != chunkHeaderIndex_.end()) {
+        return chunkHeaders_[index->second];
       }
       std::stringstream errorMsg;
       errorMsg << "no chunk with id '" << utils::fourCCToStr(id) << "' found";
@@ -329,22 +447,222 @@ namespace bw64 {
     template <typename T, typename std::enable_if<
                               std::is_floating_point<T>::value, int>::type = 0>
     uint64_t write(T* inBuffer, uint64_t frames) {
-      uint64_t bytesWritten = frames * formatChunk()->blockAlignment();
-      rawDataBuffer_.resize(bytesWritten);
-      utils::encodePcmSamples(inBuffer, &rawDataBuffer_[0],
-                              frames * formatChunk()->channelCount(),
-                              formatChunk()->bitsPerSample());
-      fileStream_.write(&rawDataBuffer_[0], bytesWritten);
-      dataChunk()->setSize(dataChunk()->size() + bytesWritten);
-      chunkHeader(utils::fourCC("data")).size = dataChunk()->size();
+      uint64_t bytesWritten = frames * blockAlignment_;
+      resizeRawDataBuffer(bytesWritten);
+      utils::encodePcmSamples(inBuffer, rawDataBuffer_.data(),
+                              frames * channels_, bitDepth_);
+      writeRawData(rawDataBuffer_.data(), bytesWritten);
+      return frames;
+    }
+
+    /**
+     * @brief Write integer frames to dataChunk
+     *
+     * Samples are converted from `int16_t`, Int24 or `int32_t` by shifting,
+     * without scaling or clipping; see Justification.
+     *
+     * @param[in]  inBuffer      Buffer to read samples from
+     * @param[in]  frames        Number of frames to write
+     * @param[in]  justification How samples are placed in the integers
+     *
+     * @returns number of frames written
+     */
+    template <typename T, typename std::enable_if<
+                              utils::IsIntSample<T>::value, int>::type = 0>
+    uint64_t write(T* inBuffer, uint64_t frames,
+                   Justification justification = Justification::left) {
+      uint64_t bytesWritten = frames * blockAlignment_;
+      resizeRawDataBuffer(bytesWritten);
+      utils::encodePcmSamples(inBuffer, rawDataBuffer_.data(),
+                              frames * channels_, bitDepth_, justification);
+      writeRawData(rawDataBuffer_.data(), bytesWritten);
+      return frames;
+    }
+
+    /**
+     * @brief Write frames to dataChunk from one buffer per channel
+     *
+     * Samples are interleaved while encoding, without an intermediate
+     * interleaved buffer.
+     *
+     * @param[in]  channelBuffers `channels()` buffers of at least `frames`
+     * samples each
+     * @param[in]  frames         Number of frames to write
+     *
+     * @returns number of frames written
+     */
+    template <typename T, typename std::enable_if<
+                              std::is_floating_point<T>::value, int>::type = 0>
+    uint64_t writePlanar(const T* const* channelBuffers, uint64_t frames) {
+      // encode about 1MB at a time to limit the size of rawDataBuffer_
+      const uint64_t maxBlockSize = uint64_t{1} << 20;
+      const uint64_t blockFrames =
+          (std::max)(uint64_t{1}, maxBlockSize / blockAlignment_);
+
+      for (uint64_t done = 0; done < frames;) {
+        const uint64_t blockSize = (std::min)(blockFrames, frames - done);
+        resizeRawDataBuffer(blockSize * blockAlignment_);
+        utils::encodePcmSamplesPlanar(channelBuffers, done,
+                                      rawDataBuffer_.data(), blockSize,
+                                      channels_, bitDepth_);
+        writeRawData(rawDataBuffer_.data(), blockSize * blockAlignment_);
+        done += blockSize;
+      }
       return frames;
     }
 
    private:
+    /// first chunk in chunks_ with the given id, or nullptr
+    template <typename ChunkType>
+    std::shared_ptr<ChunkType> findChunk(uint32_t id) const {
+      auto index = chunkIndex_.find(id);
+      if (index == chunkIndex_.end()) return nullptr;
+      return std::static_pointer_cast<ChunkType>(chunks_[index->second]);
+    }
+
+    /// append encoded samples to the data chunk
+    void writeRawData(const char* data, uint64_t size) {
+      if (writeBufferSize_) {
+        writeBufferedData(data, size);
+      } else {
+        writeStreamData(data, size);
+      }
+      dataChunk_->setSize(dataChunk_->size() + size);
+      chunkHeaders_[dataHeaderIndex_].size = dataChunk_->size();
+    }
+
+    /// write data at the current position with ioUring_ or fileStream_
+    void writeStreamData(const char* data, uint64_t size) {
+#ifdef BW64_IO_URING
+      if (ioUring_) {
+        // fileStream_ may hold data before this position, which is written
+        // when seeking past the new data
+        const std::streamoff position = fileStream_.tellp();
+        ioUring_->writeAt(dataFile_.fd(), data, size,
+                          static_cast<uint64_t>(position));
+        fileStream_.seekp(
+            utils::safeAdd(position, utils::safeCast<std::streamoff>(size)));
+      } else {
+        fileStream_.write(data, size);
+      }
+#else
+      fileStream_.write(data, size);
+#endif
+    }
+
+    /// add data to writeBuffer_, writing it whenever it is full
+    ///
+    /// fileStream_ stays at the position of the start of writeBuffer_. In
+    /// WriteMode::direct, data up to the first aligned position is written
+    /// through fileStream_ rather than being buffered.
+    void writeBufferedData(const char* data, uint64_t size) {
+      if (!writeBuffered_) {
+        writeBufferStart_ = fileStream_.tellp();
+        const uint64_t misalignment =
+            writeBufferStart_ % utils::directIoAlignment;
+        if (mode_ == WriteMode::direct && misalignment) {
+          const uint64_t head =
+              (std::min)(size, utils::directIoAlignment - misalignment);
+          fileStream_.write(data, head);
+          data += head;
+          size -= head;
+          writeBufferStart_ += head;
+        }
+      }
+
+      while (size) {
+        const uint64_t count =
+            (std::min)(size, writeBufferSize_ - writeBuffered_);
+        std::copy_n(data, count, writeBuffer_.data() + writeBuffered_);
+        writeBuffered_ += count;
+        data += count;
+        size -= count;
+        if (writeBuffered_ == writeBufferSize_) flushWriteBuffer();
+      }
+    }
+
+    /// write the contents of writeBuffer_ at the current position
+    ///
+    /// In WriteMode::direct, whole buffers are written with dataFile_, and
+    /// anything else through fileStream_.
+    void flushWriteBuffer() {
+      if (!writeBuffered_) return;
+      if (mode_ == WriteMode::direct && writeBuffered_ == writeBufferSize_) {
+        dataFile_.writeAt(writeBuffer_.data(), writeBuffered_,
+                          writeBufferStart_);
+        const uint64_t end = writeBufferStart_ + writeBuffered_;
+        fileStream_.seekp(utils::safeCast<std::streamoff>(end));
+      } else {
+        writeStreamData(writeBuffer_.data(), writeBuffered_);
+      }
+      if (!fileStream_.good())
+        throw std::runtime_error("file error while writing");
+      writeBufferStart_ += writeBuffered_;
+      writeBuffered_ = 0;
+    }
+
+    /// resize rawDataBuffer_, registering it with ioUring_ if used
+    void resizeRawDataBuffer(uint64_t size) {
+#ifdef BW64_IO_URING
+      // the registered buffer must not be freed while it is in use
+      if (ioUring_ && size > rawDataBuffer_.capacity())
+        ioUring_->unregisterBuffer();
+      rawDataBuffer_.resize(size);
+      if (ioUring_)
+        ioUring_->useBuffer(rawDataBuffer_.data(), rawDataBuffer_.capacity());
+#else
+      rawDataBuffer_.resize(size);
+#endif
+    }
+
+    /// set the file size to the end of the written data, releasing storage
+    /// reserved after it by reserveFrames()
+    void releaseReservedStorage() {
+      fileStream_.flush();
+      dataFile_.truncate(riffChunkSize() + 8u);
+    }
+
+    void closeDataFile() {
+#ifdef BW64_IO_URING
+      ioUring_.reset();
+#endif
+      dataFile_.close();
+    }
+
+    WriteMode mode_;
+    std::string filename_;
     std::ofstream fileStream_;
     std::vector<char> rawDataBuffer_;
+    // used for sample data in WriteMode::direct, or with ioUring_, and to
+    // reserve storage
+    utils::File dataFile_;
+    // file size up to which storage has been reserved by reserveFrames()
+    uint64_t reservedSize_ = 0;
+    // see setWriteBufferSize(); writeBufferSize_ is 0 if not used
+    utils::AlignedBuffer writeBuffer_;
+    uint64_t writeBufferSize_ = 0;
+    // file position of the start of writeBuffer_, and the number of bytes in
+    // it
+    uint64_t writeBufferStart_ = 0;
+    uint64_t writeBuffered_ = 0;
+#ifdef BW64_IO_URING
+    // used for sample data if supported; after rawDataBuffer_, as it may be
+    // registered
+    std::unique_ptr<utils::IoUring> ioUring_;
+#endif
     std::vector<std::shared_ptr<Chunk>> chunks_;
     std::vector<ChunkHeader> chunkHeaders_;
+    // index in chunks_ and chunkHeaders_ of the first entry with each id
+    std::unordered_map<uint32_t, size_t> chunkIndex_;
+    std::unordered_map<uint32_t, size_t> chunkHeaderIndex_;
+    // cached from the fmt and data chunks; chunkHeaders_ may be reallocated,
+    // so the data chunk header is found by index
+    std::shared_ptr<FormatInfoChunk> formatChunk_;
+    std::shared_ptr<DataChunk> dataChunk_;
+    size_t dataHeaderIndex_;
+    uint16_t channels_;
+    uint16_t bitDepth_;
+    uint16_t blockAlignment_;
     std::vector<std::shared_ptr<Chunk>> postDataChunks_;
     bool useRf64Id_{false};
   };
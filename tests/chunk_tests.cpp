@@ -376,6 +376,29 @@ TEST_CASE("axml_chunk") {
   REQUIRE(stream.str() == str_data);
 }
 
+TEST_CASE("unknown_and_junk_chunk") {
+  const std::string data("ab\0cd", 5);
+  std::istringstream inStream(data);
+
+  std::ostringstream stream;
+  UnknownChunk(inStream, utils::fourCC("abcd"), 5).write(stream);
+  UnknownChunk(utils::fourCC("abcd")).write(stream);
+  JunkChunk().write(stream);
+  REQUIRE(stream.str() == data + std::string(28, '\0'));
+}
+
+TEST_CASE("chunk_placeholder") {
+  // larger than the block of zeros used
+  const uint32_t size = 10000;
+  std::ostringstream stream;
+  utils::writeChunkPlaceholder(stream, utils::fourCC("JUNK"), size);
+
+  const std::string written = stream.str();
+  REQUIRE(written.size() == size + 8);
+  REQUIRE(written.substr(0, 8) == std::string("JUNK\x10\x27\0\0", 8));
+  REQUIRE(written.substr(8) == std::string(size, '\0'));
+}
+
 TEST_CASE("axml_chunk_bench", "[.bench]") {
   size_t size = 10000000;
 
@@ -1,6 +1,9 @@
 #include <catch2/catch.hpp>
+#include <fstream>
+#include <iterator>
 #include <sstream>
 #include <random>
+#include <thread>
 #include "bw64/bw64.hpp"
 
 using namespace bw64;
@@ -86,6 +89,36 @@ TEST_CASE("read_check_chunks") {
   bw64File->close();
 }
 
+TEST_CASE("probe") {
+  for (auto filename : {"rect_16bit.wav", "rect_24bit.wav", "rect_32bit.wav",
+                        "rect_24bit_rf64.wav",
+                        "noise_24bit_uneven_data_chunk_size.wav"}) {
+    auto bw64File = readFile(filename);
+    const FileInfo info = probe(filename);
+    REQUIRE(info.fileFormat == bw64File->fileFormat());
+    REQUIRE(info.formatTag == bw64File->formatTag());
+    REQUIRE(info.channels == bw64File->channels());
+    REQUIRE(info.sampleRate == bw64File->sampleRate());
+    REQUIRE(info.bitDepth == bw64File->bitDepth());
+    REQUIRE(info.blockAlignment == bw64File->blockAlignment());
+    REQUIRE(info.numberOfFrames == bw64File->numberOfFrames());
+
+    const auto chunks = bw64File->chunks();
+    REQUIRE(info.chunks.size() == chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+      REQUIRE(info.chunks[i].id == chunks[i].id);
+      REQUIRE(info.chunks[i].size == chunks[i].size);
+      REQUIRE(info.chunks[i].position == chunks[i].position);
+    }
+  }
+
+  REQUIRE_THROWS_AS(probe("file_not_found.wav"), std::runtime_error);
+  REQUIRE_THROWS_AS(probe("rect_24bit_noriff.wav"), std::runtime_error);
+  REQUIRE_THROWS_AS(probe("rect_24bit_nowave.wav"), std::runtime_error);
+  REQUIRE_THROWS_AS(probe("rect_24bit_wrong_fmt_size.wav"),
+                    std::runtime_error);
+}
+
 TEST_CASE("read_seek_tell") {
   auto bw64File = readFile("rect_16bit.wav");
   // should be positioned at the beginning after opening
@@ -118,6 +151,509 @@ TEST_CASE("read_seek_tell") {
   bw64File->close();
 }
 
+TEST_CASE("read_small_blocks") {
+  auto reference = readFile("rect_24bit.wav");
+  const uint64_t frames = reference->numberOfFrames();
+  const uint16_t channels = reference->channels();
+  std::vector<float> expected(frames * channels);
+  REQUIRE(reference->read(&expected[0], frames) == frames);
+
+  for (ReadMode mode : {ReadMode::stream, ReadMode::mmap, ReadMode::direct}) {
+    auto bw64File = readFile("rect_24bit.wav", mode);
+    std::vector<float> data(64 * channels);
+    uint64_t position = 0;
+    for (int block = 0; !bw64File->eof(); block++) {
+      REQUIRE(bw64File->tell() == position);
+      const uint64_t read = bw64File->read(&data[0], 64);
+      REQUIRE(read == (std::min)(uint64_t{64}, frames - position));
+      REQUIRE(std::equal(data.begin(), data.begin() + read * channels,
+                         expected.begin() + position * channels));
+      position += read;
+
+      // moving the position in other ways between reads
+      if (block % 3 == 1) {
+        bw64File->seek(-10, std::ios::cur);
+        position -= (std::min)(position, uint64_t{10});
+      } else if (block % 3 == 2) {
+        bw64File->readAt(0, &data[0], 64);
+      }
+    }
+    REQUIRE(position == frames);
+  }
+}
+
+TEST_CASE("read_mmap_file_not_found") {
+  REQUIRE_THROWS_AS(readFile("file_not_found.wav", ReadMode::mmap),
+                    std::runtime_error);
+}
+
+TEST_CASE("read_mmap_matches_stream") {
+  for (auto filename : {"rect_16bit.wav", "rect_24bit.wav", "rect_32bit.wav",
+                        "rect_24bit_rf64.wav",
+                        "noise_24bit_uneven_data_chunk_size.wav"}) {
+    auto streamFile = readFile(filename);
+    auto mmapFile = readFile(filename, ReadMode::mmap);
+    REQUIRE(mmapFile->readMode() == ReadMode::mmap);
+    REQUIRE(mmapFile->formatTag() == streamFile->formatTag());
+    REQUIRE(mmapFile->bitDepth() == streamFile->bitDepth());
+    REQUIRE(mmapFile->channels() == streamFile->channels());
+    REQUIRE(mmapFile->numberOfFrames() == streamFile->numberOfFrames());
+    REQUIRE(mmapFile->chunks().size() == streamFile->chunks().size());
+
+    const uint64_t frames = streamFile->numberOfFrames();
+    std::vector<float> streamData(frames * streamFile->channels());
+    std::vector<float> mmapData(frames * mmapFile->channels());
+    // read in two blocks to check that the position is tracked
+    mmapFile->read(&mmapData[0], frames / 2);
+    REQUIRE(mmapFile->tell() == frames / 2);
+    mmapFile->read(&mmapData[(frames / 2) * mmapFile->channels()], frames);
+    REQUIRE(mmapFile->eof());
+    REQUIRE(streamFile->read(&streamData[0], frames) == frames);
+    REQUIRE(mmapData == streamData);
+
+    mmapFile->seek(-1, std::ios::end);
+    REQUIRE(mmapFile->read(&mmapData[0], frames) == 1);
+    mmapFile->close();
+    streamFile->close();
+  }
+}
+
+TEST_CASE("read_mmap_invalid") {
+  REQUIRE_THROWS_AS(Bw64Reader("rect_24bit_noriff.wav", ReadMode::mmap),
+                    std::runtime_error);
+  REQUIRE_THROWS_AS(Bw64Reader("rect_24bit_wrong_fmt_size.wav", ReadMode::mmap),
+                    std::runtime_error);
+}
+
+TEST_CASE("read_raw") {
+  for (auto mode : {ReadMode::stream, ReadMode::mmap, ReadMode::direct}) {
+    auto bw64File = readFile("rect_24bit.wav", mode);
+    const uint64_t frames = bw64File->numberOfFrames();
+    std::vector<char> raw(frames * bw64File->blockAlignment());
+    REQUIRE(bw64File->readRaw(&raw[0], 100) == 100);
+    REQUIRE(bw64File->tell() == 100);
+    REQUIRE(bw64File->readRaw(&raw[100 * bw64File->blockAlignment()],
+                              frames) == frames - 100);
+    REQUIRE(bw64File->eof());
+
+    // raw samples decode to the same values as read()
+    std::vector<float> decoded(frames * bw64File->channels());
+    utils::decodePcmSamples(&raw[0], &decoded[0], decoded.size(), 24);
+    std::vector<float> data(frames * bw64File->channels());
+    bw64File->seek(0);
+    REQUIRE(bw64File->read(&data[0], frames) == frames);
+    REQUIRE(decoded == data);
+  }
+}
+
+TEST_CASE("view_raw") {
+  auto streamFile = readFile("rect_16bit.wav");
+  const char* view = nullptr;
+  REQUIRE_THROWS_AS(streamFile->viewRaw(&view, 10), std::runtime_error);
+
+  auto mmapFile = readFile("rect_16bit.wav", ReadMode::mmap);
+  const uint64_t frames = mmapFile->numberOfFrames();
+  std::vector<char> raw(frames * streamFile->blockAlignment());
+  streamFile->readRaw(&raw[0], frames);
+
+  mmapFile->seek(10);
+  REQUIRE(mmapFile->viewRaw(&view, 20) == 20);
+  REQUIRE(mmapFile->tell() == 30);
+  REQUIRE(std::equal(view, view + 20 * mmapFile->blockAlignment(),
+                     &raw[10 * mmapFile->blockAlignment()]));
+
+  REQUIRE(mmapFile->viewRaw(&view, frames) == frames - 30);
+  REQUIRE(mmapFile->viewRaw(&view, frames) == 0);
+  REQUIRE(view == nullptr);
+}
+
+TEST_CASE("read_int") {
+  auto bw64File = readFile("rect_24bit.wav");
+  const uint64_t frames = bw64File->numberOfFrames();
+  std::vector<float> floatData(frames * bw64File->channels());
+  std::vector<int32_t> intData(frames * bw64File->channels());
+  REQUIRE(bw64File->read(&floatData[0], frames) == frames);
+  bw64File->seek(0);
+  REQUIRE(bw64File->read(&intData[0], frames) == frames);
+  for (size_t i = 0; i < intData.size(); i++)
+    REQUIRE(intData[i] / 2147483648.0f == floatData[i]);
+
+  // 24 bit samples can't be read as right justified int16_t, and must not
+  // move the position
+  std::vector<int16_t> shortData(frames * bw64File->channels());
+  bw64File->seek(0);
+  REQUIRE_THROWS_AS(
+      bw64File->read(&shortData[0], frames, Justification::right),
+      std::runtime_error);
+  REQUIRE(bw64File->tell() == 0);
+}
+
+TEST_CASE("read_planar") {
+  for (ReadMode mode : {ReadMode::stream, ReadMode::mmap}) {
+    auto bw64File = readFile("rect_24bit.wav", mode);
+    const uint64_t frames = bw64File->numberOfFrames();
+    const uint16_t channels = bw64File->channels();
+    std::vector<float> interleaved(frames * channels);
+    REQUIRE(bw64File->read(&interleaved[0], frames) == frames);
+
+    // read in two parts, the second of which runs past the end
+    std::vector<std::vector<float>> planar(channels,
+                                           std::vector<float>(frames + 10));
+    std::vector<float*> channelBuffers;
+    for (auto& buffer : planar) channelBuffers.push_back(buffer.data());
+    bw64File->seek(0);
+    REQUIRE(bw64File->readPlanar(channelBuffers.data(), 100) == 100);
+    for (auto& buffer : channelBuffers) buffer += 100;
+    REQUIRE(bw64File->readPlanar(channelBuffers.data(), frames) ==
+            frames - 100);
+    REQUIRE(bw64File->eof());
+
+    for (uint64_t frame = 0; frame < frames; frame++)
+      for (uint16_t channel = 0; channel < channels; channel++)
+        REQUIRE(planar[channel][frame] ==
+                interleaved[frame * channels + channel]);
+  }
+}
+
+TEST_CASE("read_channels") {
+  for (ReadMode mode : {ReadMode::stream, ReadMode::mmap}) {
+    auto bw64File = readFile("rect_24bit.wav", mode);
+    const uint64_t frames = bw64File->numberOfFrames();
+    const uint16_t channels = bw64File->channels();
+    std::vector<float> interleaved(frames * channels);
+    REQUIRE(bw64File->read(&interleaved[0], frames) == frames);
+
+    const std::vector<uint16_t> selected = {1, 0, 1};
+    std::vector<float> data(frames * selected.size());
+    bw64File->seek(0);
+    REQUIRE(bw64File->readChannels(&data[0], 100, selected) == 100);
+    REQUIRE(bw64File->readChannels(&data[100 * selected.size()], frames,
+                                   selected) == frames - 100);
+    REQUIRE(bw64File->eof());
+    for (uint64_t frame = 0; frame < frames; frame++)
+      for (size_t i = 0; i < selected.size(); i++)
+        REQUIRE(data[frame * selected.size() + i] ==
+                interleaved[frame * channels + selected[i]]);
+
+    // out of range channels throw without moving the position
+    bw64File->seek(0);
+    REQUIRE_THROWS_AS(bw64File->readChannels(&data[0], 1, {channels}),
+                      std::runtime_error);
+    REQUIRE(bw64File->tell() == 0);
+  }
+}
+
+TEST_CASE("read_pack_format_track_uids") {
+  const uint16_t channels = 4;
+  const uint64_t frames = 1000;
+  {
+    auto chnaChunk = std::make_shared<ChnaChunk>();
+    chnaChunk->addAudioId(
+        AudioId(1, "ATU_00000001", "AT_00031001_01", "AP_00031001"));
+    chnaChunk->addAudioId(
+        AudioId(3, "ATU_00000002", "AT_00010001_01", "AP_00010002"));
+    chnaChunk->addAudioId(
+        AudioId(4, "ATU_00000003", "AT_00010002_01", "AP_00010002"));
+    chnaChunk->addAudioId(
+        AudioId(1, "ATU_00000004", "AT_00031001_01", "AP_00031002"));
+    auto bw64File =
+        writeFile("read_pack_format.wav", channels, 48000u, 24u, chnaChunk);
+    std::vector<float> data(frames * channels);
+    for (size_t i = 0; i < data.size(); i++)
+      data[i] = static_cast<float>(i % channels) / 8.f;
+    bw64File->write(&data[0], frames);
+    bw64File->close();
+  }
+
+  auto bw64File = readFile("read_pack_format.wav");
+  REQUIRE(bw64File->channelsForPackFormat("AP_00010002") ==
+          std::vector<uint16_t>{2, 3});
+  REQUIRE(bw64File->channelsForTrackUids({"ATU_00000004", "ATU_00000002"}) ==
+          std::vector<uint16_t>{0, 2});
+  REQUIRE_THROWS_AS(bw64File->channelsForPackFormat("AP_00010003"),
+                    std::runtime_error);
+  REQUIRE_THROWS_AS(bw64File->channelsForTrackUids({"ATU_00000005"}),
+                    std::runtime_error);
+
+  std::vector<float> data(frames * 2);
+  REQUIRE(bw64File->readPackFormat(&data[0], frames, "AP_00010002") ==
+          frames);
+  for (uint64_t frame = 0; frame < frames; frame++) {
+    REQUIRE(data[frame * 2] == 2.f / 8.f);
+    REQUIRE(data[frame * 2 + 1] == 3.f / 8.f);
+  }
+
+  bw64File->seek(0);
+  REQUIRE(bw64File->readTrackUids(&data[0], frames,
+                                  {"ATU_00000002", "ATU_00000001"}) == frames);
+  for (uint64_t frame = 0; frame < frames; frame++) {
+    REQUIRE(data[frame * 2] == 2.f / 8.f);
+    REQUIRE(data[frame * 2 + 1] == 0.f);
+  }
+
+  // files without a chna chunk can not be used
+  auto noChnaFile = readFile("rect_24bit.wav");
+  REQUIRE_THROWS_AS(noChnaFile->channelsForTrackUids({"ATU_00000001"}),
+                    std::runtime_error);
+}
+
+TEST_CASE("read_at") {
+  for (ReadMode mode : {ReadMode::stream, ReadMode::mmap, ReadMode::direct}) {
+    auto bw64File = readFile("rect_24bit.wav", mode);
+    const uint64_t frames = bw64File->numberOfFrames();
+    const uint16_t channels = bw64File->channels();
+    std::vector<float> interleaved(frames * channels);
+    REQUIRE(bw64File->read(&interleaved[0], frames) == frames);
+
+    bw64File->seek(10);
+    std::vector<float> data(frames * channels);
+    for (uint64_t offset : {uint64_t{0}, uint64_t{7}, frames - 5}) {
+      const uint64_t expected = (std::min)(uint64_t{100}, frames - offset);
+      REQUIRE(bw64File->readAt(offset, &data[0], 100) == expected);
+      for (uint64_t i = 0; i < expected * channels; i++)
+        REQUIRE(data[i] == interleaved[offset * channels + i]);
+    }
+    REQUIRE(bw64File->readAt(frames, &data[0], 100) == 0);
+    REQUIRE(bw64File->readAt(frames + 1, &data[0], 100) == 0);
+
+    // the position used by read() is not changed
+    REQUIRE(bw64File->tell() == 10);
+  }
+}
+
+TEST_CASE("read_parallel") {
+  const uint16_t channels = 3;
+  const uint64_t frames = 100000;
+  std::vector<float> data(frames * channels);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<float>(i % 1000) / 1000.f;
+  {
+    auto bw64File = writeFile("read_parallel.wav", channels, 48000u, 24u);
+    bw64File->write(&data[0], frames);
+    bw64File->close();
+  }
+
+  for (ReadMode mode : {ReadMode::stream, ReadMode::mmap, ReadMode::direct}) {
+    auto bw64File = readFile("read_parallel.wav", mode);
+    std::vector<float> reference(frames * channels);
+    REQUIRE(bw64File->read(&reference[0], frames) == frames);
+
+    bw64File->setReadThreads(4);
+    REQUIRE(bw64File->readThreads() == 4);
+    bw64File->seek(10);
+    std::vector<float> parallel(frames * channels);
+    REQUIRE(bw64File->read(&parallel[0], frames) == frames - 10);
+    REQUIRE(bw64File->eof());
+    REQUIRE(std::equal(parallel.begin(), parallel.end() - 10 * channels,
+                       reference.begin() + 10 * channels));
+
+    // readAt may be called from several threads at once
+    std::vector<std::vector<float>> results(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < results.size(); t++) {
+      threads.emplace_back([&, t]() {
+        results[t].resize(1000 * channels);
+        bw64File->readAt(t * 1000, results[t].data(), 1000);
+      });
+    }
+    for (auto& thread : threads) thread.join();
+    for (size_t t = 0; t < results.size(); t++)
+      REQUIRE(std::equal(results[t].begin(), results[t].end(),
+                         reference.begin() + t * 1000 * channels));
+  }
+}
+
+TEST_CASE("read_ahead") {
+  auto bw64File = readFile("rect_24bit.wav");
+  const uint64_t frames = bw64File->numberOfFrames();
+  const uint16_t channels = bw64File->channels();
+  std::vector<float> reference(frames * channels);
+  REQUIRE(bw64File->read(&reference[0], frames) == frames);
+
+  bw64File->seek(3);
+  bw64File->setReadAhead(3, 50);
+  std::vector<float> data(frames * channels);
+  REQUIRE(bw64File->read(&data[0], 70) == 70);
+  REQUIRE(bw64File->tell() == 73);
+  std::vector<char> raw(30 * bw64File->blockAlignment());
+  REQUIRE(bw64File->readRaw(&raw[0], 30) == 30);
+  REQUIRE(bw64File->read(&data[100 * channels], frames) == frames - 103);
+  REQUIRE(bw64File->eof());
+  REQUIRE(std::equal(data.begin(), data.begin() + 70 * channels,
+                     reference.begin() + 3 * channels));
+  REQUIRE(std::equal(data.begin() + 100 * channels,
+                     data.begin() + (frames - 3) * channels,
+                     reference.begin() + 103 * channels));
+
+  // seeking restarts reading ahead from the new position
+  bw64File->seek(0);
+  REQUIRE(bw64File->read(&data[0], frames) == frames);
+  REQUIRE(data == reference);
+
+  bw64File->setReadAhead(0);
+  bw64File->seek(0);
+  REQUIRE(bw64File->read(&data[0], frames) == frames);
+  REQUIRE(data == reference);
+
+  auto mappedFile = readFile("rect_24bit.wav", ReadMode::mmap);
+  REQUIRE_THROWS_AS(mappedFile->setReadAhead(2), std::runtime_error);
+}
+
+TEST_CASE("read_direct") {
+  for (auto filename : {"rect_16bit.wav", "rect_24bit.wav", "rect_32bit.wav",
+                        "rect_24bit_rf64.wav",
+                        "noise_24bit_uneven_data_chunk_size.wav"}) {
+    auto streamFile = readFile(filename);
+    auto directFile = readFile(filename, ReadMode::direct);
+    REQUIRE(directFile->readMode() == ReadMode::direct);
+    REQUIRE(directFile->numberOfFrames() == streamFile->numberOfFrames());
+
+    const uint64_t frames = streamFile->numberOfFrames();
+    const uint16_t channels = streamFile->channels();
+    std::vector<float> streamData(frames * channels);
+    REQUIRE(streamFile->read(&streamData[0], frames) == frames);
+
+    // read in pieces which do not start or end on aligned positions
+    std::vector<float> directData(frames * channels);
+    for (uint64_t done = 0; done < frames;)
+      done += directFile->read(&directData[done * channels], 333);
+    REQUIRE(directFile->eof());
+    REQUIRE(directData == streamData);
+
+    directFile->seek(-1, std::ios::end);
+    REQUIRE(directFile->read(&directData[0], frames) == 1);
+    REQUIRE(directData[0] == streamData[(frames - 1) * channels]);
+
+    directFile->seek(5);
+    directFile->setReadAhead(2, 100);
+    REQUIRE(directFile->read(&directData[0], frames) == frames - 5);
+    REQUIRE(std::equal(directData.begin(), directData.end() - 5 * channels,
+                       streamData.begin() + 5 * channels));
+    directFile->close();
+  }
+}
+
+TEST_CASE("read_lazy_chunks") {
+  const std::string unknownData(1001, 'x');
+  {
+    std::istringstream unknownStream(unknownData);
+    std::vector<std::shared_ptr<Chunk>> additionalChunks;
+    additionalChunks.push_back(std::make_shared<UnknownChunk>(
+        unknownStream, utils::fourCC("abcd"), unknownData.size()));
+    auto chnaChunk = std::make_shared<ChnaChunk>();
+    chnaChunk->addAudioId(
+        AudioId(1, "ATU_00000001", "AT_00010001_01", "AP_00010002"));
+    additionalChunks.push_back(chnaChunk);
+    Bw64Writer writer("read_lazy_chunks.wav", 1, 48000, 24, additionalChunks);
+    writer.setAxmlChunk(std::make_shared<AxmlChunk>("axml"));
+    std::vector<float> data(100, 0.25f);
+    writer.write(&data[0], 100);
+    writer.close();
+  }
+
+  for (ReadMode mode : {ReadMode::stream, ReadMode::mmap, ReadMode::direct}) {
+    auto bw64File = readFile("read_lazy_chunks.wav", mode);
+    std::vector<float> data(100);
+    REQUIRE(bw64File->read(&data[0], 10) == 10);
+
+    // chunks may be loaded from several threads at once
+    std::vector<std::shared_ptr<Chunk>> unknown(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < unknown.size(); t++)
+      threads.emplace_back([&, t]() {
+        unknown[t] = bw64File->getChunk(utils::fourCC("abcd"));
+      });
+    for (auto& thread : threads) thread.join();
+    REQUIRE(unknown[0]);
+    REQUIRE(unknown[0]->size() == unknownData.size());
+    for (auto& chunk : unknown) REQUIRE(chunk == unknown[0]);
+
+    std::ostringstream unknownWritten;
+    unknown[0]->write(unknownWritten);
+    REQUIRE(unknownWritten.str() == unknownData);
+
+    REQUIRE(bw64File->chnaChunk()->numUids() == 1);
+    REQUIRE(bw64File->axmlChunk()->data() == "axml");
+    REQUIRE(bw64File->getChunk(utils::fourCC("fmt ")) ==
+            bw64File->formatChunk());
+    REQUIRE(bw64File->getChunk(utils::fourCC("efgh")) == nullptr);
+
+    // loading chunks does not move the current position
+    REQUIRE(bw64File->tell() == 10);
+    REQUIRE(bw64File->read(&data[0], 100) == 90);
+    REQUIRE(data[0] == Approx(0.25f).margin(1e-4));
+
+    // loaded chunks are kept after closing
+    bw64File->close();
+    REQUIRE(bw64File->axmlChunk()->data() == "axml");
+  }
+}
+
+TEST_CASE("read_lazy_chunks_errors") {
+  // a 'chna' chunk with the wrong number of tracks
+  {
+    auto chnaChunk = std::make_shared<ChnaChunk>();
+    chnaChunk->addAudioId(
+        AudioId(1, "ATU_00000001", "AT_00010001_01", "AP_00010002"));
+    Bw64Writer writer("read_lazy_chunks_errors.wav", 1, 48000, 24,
+                      {chnaChunk});
+    writer.setAxmlChunk(std::make_shared<AxmlChunk>("axml"));
+    writer.close();
+  }
+  for (auto& header : probe("read_lazy_chunks_errors.wav").chunks) {
+    if (header.id != utils::fourCC("chna")) continue;
+    std::fstream file("read_lazy_chunks_errors.wav",
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(header.position + 8u);
+    file.put(7);
+  }
+
+  for (ReadMode mode : {ReadMode::stream, ReadMode::mmap, ReadMode::direct}) {
+    // the error is thrown when the chunk is accessed, not when opening
+    auto bw64File = readFile("read_lazy_chunks_errors.wav", mode);
+    REQUIRE(bw64File->hasChunk(utils::fourCC("chna")));
+    REQUIRE_THROWS_AS(bw64File->chnaChunk(), std::runtime_error);
+    REQUIRE_THROWS_AS(bw64File->chnaChunk(), std::runtime_error);
+    REQUIRE(bw64File->axmlChunk()->data() == "axml");
+
+    // chunks not accessed before closing can not be loaded afterwards, but
+    // the chunk list is still available
+    auto closedFile = readFile("read_lazy_chunks_errors.wav", mode);
+    closedFile->close();
+    REQUIRE_THROWS_AS(closedFile->axmlChunk(), std::runtime_error);
+    REQUIRE(closedFile->hasChunk(utils::fourCC("axml")));
+    REQUIRE(closedFile->chunks().size() == bw64File->chunks().size());
+  }
+}
+
+TEST_CASE("read_many_chunks") {
+  const uint32_t numChunks = 2000;
+  auto chunkId = [](uint32_t i) {
+    return utils::fourCC("c000") + ((i % 10) << 24) + ((i / 10 % 10) << 16) +
+           ((i / 100 % 10) << 8);
+  };
+  {
+    std::vector<std::shared_ptr<Chunk>> additionalChunks;
+    for (uint32_t i = 0; i < numChunks; i++) {
+      // two chunks with each id, of different sizes
+      std::istringstream data(std::string(i + 1, 'x'));
+      additionalChunks.push_back(
+          std::make_shared<UnknownChunk>(data, chunkId(i), i + 1));
+    }
+    Bw64Writer writer("read_many_chunks.wav", 1, 48000, 16, additionalChunks);
+    writer.close();
+  }
+
+  auto bw64File = readFile("read_many_chunks.wav");
+  REQUIRE(bw64File->chunks().size() == numChunks + 4);
+  for (uint32_t i = 0; i < numChunks / 2; i++) {
+    REQUIRE(bw64File->hasChunk(chunkId(i)));
+    // the first chunk with each id is found
+    REQUIRE(bw64File->getChunk(chunkId(i))->size() == i + 1);
+  }
+  REQUIRE_FALSE(bw64File->hasChunk(utils::fourCC("cxyz")));
+}
+
 TEST_CASE("write_16bit") {
   auto bw64File = writeFile("zeros_16bit.wav", 2u, 48000u, 16u);
 
@@ -160,6 +696,349 @@ TEST_CASE("write_32bit") {
   bw64File->close();
 }
 
+TEST_CASE("write_small_blocks") {
+  const uint16_t channels = 2;
+  const uint64_t frames = 10000;
+  std::vector<float> data(frames * channels);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<float>(i % 100) / 100.f;
+  {
+    auto bw64File = writeFile("write_small_blocks.wav", channels, 48000u, 16u);
+    for (uint64_t done = 0; done < frames; done += 16) {
+      REQUIRE(bw64File->write(&data[done * channels], 16) == 16);
+      REQUIRE(bw64File->framesWritten() == done + 16);
+    }
+    bw64File->close();
+  }
+
+  auto bw64File = readFile("write_small_blocks.wav");
+  REQUIRE(bw64File->numberOfFrames() == frames);
+  std::vector<float> readData(frames * channels);
+  REQUIRE(bw64File->read(&readData[0], frames) == frames);
+  for (size_t i = 0; i < data.size(); i++)
+    REQUIRE(readData[i] == Approx(data[i]).margin(1e-4));
+}
+
+TEST_CASE("write_read_int") {
+  const int frames = 4800;
+  std::vector<int32_t> data(frames * 2);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<int32_t>(i * 0x10001 - 0x1000000);
+
+  for (auto bitDepth : {16, 24, 32}) {
+    {
+      auto bw64File = writeFile("write_read_int.wav", 2u, 48000u, bitDepth);
+      REQUIRE(bw64File->write(&data[0], frames / 2) == frames / 2);
+      REQUIRE(bw64File->write(&data[frames], frames / 2) == frames / 2);
+      REQUIRE(bw64File->framesWritten() == frames);
+      bw64File->close();
+    }
+    auto bw64File = readFile("write_read_int.wav");
+    std::vector<int32_t> readData(frames * 2);
+    REQUIRE(bw64File->read(&readData[0], frames) == frames);
+    const int shift = 32 - bitDepth;
+    for (size_t i = 0; i < data.size(); i++)
+      REQUIRE(readData[i] == utils::shiftSample(data[i] >> shift, shift));
+  }
+}
+
+TEST_CASE("write_read_planar") {
+  const uint16_t channels = 3;
+  const uint64_t frames = 4800;
+  std::vector<std::vector<float>> planar(channels, std::vector<float>(frames));
+  for (uint16_t channel = 0; channel < channels; channel++)
+    for (uint64_t frame = 0; frame < frames; frame++)
+      planar[channel][frame] =
+          static_cast<float>((frame * (channel + 1)) % 200) / 100.f - 1.f;
+  std::vector<float*> channelBuffers;
+  for (auto& buffer : planar) channelBuffers.push_back(buffer.data());
+
+  for (auto bitDepth : {16, 24, 32}) {
+    {
+      auto bw64File =
+          writeFile("write_read_planar.wav", channels, 48000u, bitDepth);
+      REQUIRE(bw64File->writePlanar(channelBuffers.data(), 100) == 100);
+      for (auto& buffer : channelBuffers) buffer += 100;
+      REQUIRE(bw64File->writePlanar(channelBuffers.data(), frames - 100) ==
+              frames - 100);
+      for (auto& buffer : channelBuffers) buffer -= 100;
+      REQUIRE(bw64File->framesWritten() == frames);
+      bw64File->close();
+    }
+    auto bw64File = readFile("write_read_planar.wav");
+    std::vector<float> readData(frames * channels);
+    REQUIRE(bw64File->read(&readData[0], frames) == frames);
+    for (uint64_t frame = 0; frame < frames; frame++)
+      for (uint16_t channel = 0; channel < channels; channel++)
+        REQUIRE(readData[frame * channels + channel] ==
+                Approx(planar[channel][frame]).margin(1e-4));
+  }
+}
+
+std::vector<char> readFileBytes(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(file),
+                           std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("write_direct") {
+  // odd number of 3 byte frames spanning several direct I/O blocks
+  const uint64_t frames = 700001;
+  std::vector<float> data(frames);
+  for (uint64_t i = 0; i < frames; i++)
+    data[i] = static_cast<float>(i % 1000) / 1000.f - 0.5f;
+
+  for (auto mode : {WriteMode::stream, WriteMode::direct}) {
+    auto bw64File = writeFile(mode == WriteMode::direct ? "write_direct.wav"
+                                                        : "write_stream.wav",
+                              1u, 48000u, 24u, nullptr, nullptr, mode);
+    REQUIRE(bw64File->writeMode() == mode);
+    // uneven pieces, so that writes start and end at unaligned positions
+    uint64_t done = 0;
+    for (uint64_t piece = 1; done < frames; piece = piece * 3 + 7) {
+      const uint64_t count = (std::min)(piece, frames - done);
+      REQUIRE(bw64File->write(&data[done], count) == count);
+      done += count;
+    }
+    REQUIRE(bw64File->framesWritten() == frames);
+    bw64File->close();
+  }
+
+  const std::vector<char> streamBytes = readFileBytes("write_stream.wav");
+  REQUIRE(readFileBytes("write_direct.wav") == streamBytes);
+
+  auto bw64File = readFile("write_direct.wav", ReadMode::direct);
+  std::vector<float> readData(frames);
+  REQUIRE(bw64File->read(&readData[0], frames) == frames);
+  for (uint64_t i = 0; i < frames; i += 997)
+    REQUIRE(readData[i] == Approx(data[i]).margin(1e-4));
+}
+
+TEST_CASE("write_buffered") {
+  const uint16_t channels = 3;
+  const uint64_t frames = 20000;
+  std::vector<float> data(frames * channels);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<float>(i % 1000) / 1000.f - 0.5f;
+
+  auto write = [&](const std::string& filename, WriteMode mode,
+                   uint64_t bufferSize) {
+    auto bw64File = writeFile(filename, channels, 48000u, 24u, nullptr,
+                              nullptr, mode);
+    bw64File->setWriteBufferSize(bufferSize);
+    for (uint64_t done = 0; done < frames; done += 37) {
+      const uint64_t count = (std::min)(uint64_t{37}, frames - done);
+      REQUIRE(bw64File->write(&data[done * channels], count) == count);
+      REQUIRE(bw64File->framesWritten() == done + count);
+      if (done == 370) {
+        // changing the size part way through writes what is buffered
+        bw64File->setWriteBufferSize(bufferSize * 2);
+        REQUIRE(bw64File->writeBufferSize() >= bufferSize * 2);
+      }
+    }
+    bw64File->close();
+  };
+
+  write("write_unbuffered.wav", WriteMode::stream, 0);
+  const std::vector<char> expected = readFileBytes("write_unbuffered.wav");
+  for (auto mode : {WriteMode::stream, WriteMode::direct}) {
+    for (uint64_t bufferSize : {1000, 4096, 65536}) {
+      write("write_buffered.wav", mode, bufferSize);
+      REQUIRE(readFileBytes("write_buffered.wav") == expected);
+    }
+  }
+
+  auto bw64File = writeFile("write_buffered.wav", 1, 48000u, 16u, nullptr,
+                            nullptr, WriteMode::direct);
+  REQUIRE(bw64File->writeBufferSize() == 1u << 20);
+  bw64File->setWriteBufferSize(5000);
+  REQUIRE(bw64File->writeBufferSize() == 8192);
+}
+
+TEST_CASE("write_reserved") {
+  const uint16_t channels = 2;
+  const uint64_t frames = 10000;
+  std::vector<float> data(frames * channels);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<float>(i % 1000) / 1000.f - 0.5f;
+
+  auto write = [&](const std::string& filename, WriteMode mode,
+                   uint64_t reserve) {
+    auto bw64File = writeFile(filename, channels, 48000u, 24u, nullptr,
+                              nullptr, mode);
+    if (reserve) bw64File->reserveFrames(reserve);
+    bw64File->write(data.data(), frames / 2);
+    // reserving less than is already reserved does nothing
+    if (reserve) bw64File->reserveFrames(reserve / 2);
+    bw64File->write(&data[frames / 2 * channels], frames / 2);
+    bw64File->close();
+    REQUIRE_THROWS_AS(bw64File->reserveFrames(1), std::runtime_error);
+  };
+
+  // writing fewer or more frames than reserved gives the same file as not
+  // reserving, with unused storage released
+  write("write_unreserved.wav", WriteMode::stream, 0);
+  const std::vector<char> expected = readFileBytes("write_unreserved.wav");
+  for (auto mode : {WriteMode::stream, WriteMode::direct}) {
+    for (uint64_t reserve : {uint64_t{1000}, uint64_t{1} << 20}) {
+      write("write_reserved.wav", mode, reserve);
+      REQUIRE(readFileBytes("write_reserved.wav") == expected);
+    }
+  }
+}
+
+TEST_CASE("write_async") {
+  const uint16_t channels = 2;
+  const uint64_t frames = 20000;
+  std::vector<float> data(frames * channels);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<float>(i % 1000) / 1000.f - 0.5f;
+
+  {
+    auto bw64File = writeFile("write_sync.wav", channels, 48000u, 24u);
+    bw64File->write(data.data(), frames);
+    bw64File->close();
+  }
+
+  // with a ring buffer large enough for all frames, nothing is dropped and
+  // the file is the same as when writing directly
+  {
+    Bw64AsyncWriter writer(writeFile("write_async.wav", channels, 48000u, 24u),
+                           frames, 1000);
+    REQUIRE(writer.channels() == channels);
+    REQUIRE(writer.bufferFrames() == frames);
+    for (uint64_t done = 0; done < frames; done += 100)
+      REQUIRE(writer.write(&data[done * channels], 100));
+    writer.close();
+    REQUIRE(writer.framesWritten() == frames);
+    REQUIRE(writer.overruns() == 0);
+  }
+  REQUIRE(readFileBytes("write_async.wav") == readFileBytes("write_sync.wav"));
+
+  // only running empty after writing counts as an underrun, not waiting
+  {
+    Bw64AsyncWriter writer(writeFile("write_async.wav", channels, 48000u, 24u),
+                           1000, 100, std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(writer.underruns() == 0);
+    REQUIRE(writer.write(data.data(), 500));
+    while (writer.framesWritten() < 500)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(writer.underruns() == 1);
+    writer.close();
+  }
+
+  // frames which do not fit are dropped
+  {
+    Bw64AsyncWriter writer(writeFile("write_async.wav", channels, 48000u, 24u),
+                           100, 10);
+    REQUIRE_FALSE(writer.write(data.data(), 101));
+    REQUIRE(writer.overruns() == 1);
+    writer.close();
+    REQUIRE(writer.framesWritten() == 0);
+  }
+}
+
+TEST_CASE("player") {
+  const uint16_t channels = 2;
+  const uint64_t frames = 20000;
+  {
+    std::vector<float> data(frames * channels);
+    for (size_t i = 0; i < data.size(); i++)
+      data[i] = static_cast<float>(i % 1000) / 1000.f - 0.5f;
+    auto bw64File = writeFile("player.wav", channels, 48000u, 24u);
+    bw64File->write(data.data(), frames);
+  }
+  std::vector<float> expected(frames * channels);
+  readFile("player.wav")->read(expected.data(), frames);
+
+  Bw64Player player(readFile("player.wav"), 4000, 1000,
+                    std::chrono::milliseconds(1));
+  REQUIRE(player.channels() == channels);
+  REQUIRE(player.numberOfFrames() == frames);
+  REQUIRE(player.bufferFrames() == 4000);
+
+  // pull until count frames have been played, as an audio callback would
+  std::vector<float> out(frames * channels);
+  auto play = [&](uint64_t count) {
+    uint64_t done = 0;
+    while (done < count) {
+      const uint64_t pulled = player.pull(
+          &out[done * channels], (std::min)(uint64_t{300}, count - done));
+      if (!pulled) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      done += pulled;
+    }
+  };
+
+  play(frames);
+  REQUIRE(player.tell() == frames);
+  REQUIRE(out == expected);
+
+  // after the end, silence is output without counting underruns
+  const uint64_t underruns = player.underruns();
+  std::vector<float> silence(10 * channels, 1.f);
+  REQUIRE(player.pull(silence.data(), 10) == 0);
+  REQUIRE(silence == std::vector<float>(10 * channels, 0.f));
+  REQUIRE(player.underruns() == underruns);
+
+  // after seeking, only frames from the new position are returned, even if
+  // the ring buffer was full before
+  for (uint64_t position : {12345u, 100u, 19990u}) {
+    player.seek(position);
+    REQUIRE(player.tell() == position);
+    const uint64_t count = frames - position;
+    play(count);
+    REQUIRE(std::equal(out.begin(), out.begin() + count * channels,
+                       expected.begin() + position * channels));
+  }
+  player.seek(500);
+  play(10);
+  player.seek(600);
+  play(10);
+  REQUIRE(std::equal(out.begin(), out.begin() + 10 * channels,
+                     expected.begin() + 600 * channels));
+
+  player.close();
+}
+
+TEST_CASE("player_seek_while_filling") {
+  const uint16_t channels = 2;
+  const uint64_t frames = 20000;
+  {
+    std::vector<float> data(frames * channels);
+    for (size_t i = 0; i < data.size(); i++)
+      data[i] = static_cast<float>(i % 1000) / 1000.f - 0.5f;
+    auto bw64File = writeFile("player_seek.wav", channels, 48000u, 24u);
+    bw64File->write(data.data(), frames);
+  }
+  std::vector<float> expected(frames * channels);
+  readFile("player_seek.wav")->read(expected.data(), frames);
+
+  // small blocks and no poll interval, so that the worker is usually part
+  // way through decoding a block when seeking
+  Bw64Player player(readFile("player_seek.wav"), 256, 16,
+                    std::chrono::microseconds(0));
+  std::mt19937 random(1);
+  std::uniform_int_distribution<uint64_t> randomFrame(0, frames - 1);
+  std::vector<float> out(64 * channels);
+  bool matches = true;
+  for (int seek = 0; seek < 500; seek++) {
+    player.seek(randomFrame(random));
+    // play until some frames have been returned from the new position
+    for (uint64_t pulled = 0; pulled < 100 && player.tell() < frames;) {
+      const uint64_t position = player.tell();
+      const uint64_t count = player.pull(out.data(), 64);
+      matches &= std::equal(out.begin(), out.begin() + count * channels,
+                            expected.begin() + position * channels);
+      pulled += count;
+      if (!count) std::this_thread::yield();
+    }
+  }
+  REQUIRE(matches);
+  player.close();
+}
+
 void writeClipped(const std::string& filename, uint16_t bitDepth,
                   uint64_t frames, uint16_t channels = 1u,
                   uint32_t sampleRate = 48000u) {
@@ -290,6 +1169,34 @@ TEST_CASE("write_read_odd_chunks_after") {
   }
 }
 
+TEST_CASE("writer_creation_bench", "[.bench]") {
+  auto chnaChunk = std::make_shared<ChnaChunk>();
+  chnaChunk->addAudioId(
+      AudioId(1, "ATU_00000001", "AT_00031001_01", "AP_00031001"));
+  chnaChunk->addAudioId(
+      AudioId(2, "ATU_00000002", "AT_00031002_01", "AP_00031002"));
+
+  BENCHMARK("create and close") {
+    auto bw64File = writeFile("writer_creation_bench.wav", 2, 48000u, 24u);
+    bw64File->close();
+    return bw64File->framesWritten();
+  };
+
+  BENCHMARK("create, set chna and close") {
+    auto bw64File = writeFile("writer_creation_bench.wav", 2, 48000u, 24u);
+    bw64File->setChnaChunk(chnaChunk);
+    bw64File->close();
+    return bw64File->framesWritten();
+  };
+
+  BENCHMARK("create with chna and close") {
+    auto bw64File =
+        writeFile("writer_creation_bench.wav", 2, 48000u, 24u, chnaChunk);
+    bw64File->close();
+    return bw64File->framesWritten();
+  };
+}
+
 TEST_CASE("write_read_big", "[.big]") {
   uint64_t frames = 0x90000000UL;
   uint64_t blockSize = 0x1000UL;
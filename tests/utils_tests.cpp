@@ -2,6 +2,13 @@
 #include "windows.h"  // This is to trigger max / std::numeric_limits::max conflict
 #endif
 #include <catch2/catch.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <thread>
 #include "bw64/bw64.hpp"
 
 using namespace bw64;
@@ -77,6 +84,178 @@ TEST_CASE("decode_pcm_samples_32bit") {
   REQUIRE(samples[4] == Approx(decodedSamples[4]).epsilon(1e-6));
 }
 
+TEST_CASE("decode_pcm_samples_int") {
+  const char* encoded24bit =
+      "\x00\x00\x00"
+      "\xff\xff\x7f"
+      "\x00\x00\x80"
+      "\x34\x12\x00"
+      "\xcc\xed\xff";
+
+  int32_t left32[5];
+  utils::decodePcmSamples(encoded24bit, left32, 5, 24);
+  REQUIRE(left32[0] == 0);
+  REQUIRE(left32[1] == 0x7fffff00);
+  REQUIRE(left32[2] == INT32_MIN);
+  REQUIRE(left32[3] == 0x123400);
+  REQUIRE(left32[4] == -0x123400);
+
+  int32_t right32[5];
+  utils::decodePcmSamples(encoded24bit, right32, 5, 24, Justification::right);
+  REQUIRE(right32[1] == 0x7fffff);
+  REQUIRE(right32[2] == -0x800000);
+  REQUIRE(right32[3] == 0x1234);
+  REQUIRE(right32[4] == -0x1234);
+
+  // truncates towards negative infinity
+  int16_t left16[5];
+  utils::decodePcmSamples(encoded24bit, left16, 5, 24);
+  REQUIRE(left16[1] == 0x7fff);
+  REQUIRE(left16[2] == INT16_MIN);
+  REQUIRE(left16[3] == 0x12);
+  REQUIRE(left16[4] == -0x13);
+
+  REQUIRE_THROWS_AS(utils::decodePcmSamples(encoded24bit, left16, 5, 24,
+                                            Justification::right),
+                    std::runtime_error);
+  REQUIRE_THROWS_AS(utils::decodePcmSamples(encoded24bit, left16, 5, 8),
+                    std::runtime_error);
+
+  Int24 packed[5];
+  const char* packedBytes = reinterpret_cast<const char*>(packed);
+  utils::decodePcmSamples(encoded24bit, packed, 5, 24);
+  REQUIRE(std::string(packedBytes, 15) == std::string(encoded24bit, 15));
+
+  const char* encoded16bit =
+      "\x00\x80"
+      "\x34\x12";
+  utils::decodePcmSamples(encoded16bit, packed, 2, 16);
+  REQUIRE(std::string(packedBytes, 6) ==
+          std::string("\x00\x00\x80\x00\x34\x12", 6));
+  utils::decodePcmSamples(encoded16bit, packed, 2, 16, Justification::right);
+  REQUIRE(std::string(packedBytes, 6) ==
+          std::string("\x00\x80\xff\x34\x12\x00", 6));
+}
+
+template <typename T>
+void checkSimdDecode(const std::vector<char>& encoded, uint16_t bits) {
+  const uint64_t maxSamples = encoded.size() / (bits / 8);
+  std::vector<T> reference(maxSamples);
+  std::vector<T> decoded(maxSamples);
+  const int maxIsa = static_cast<int>(simd::activeIsa());
+  for (int isa = 0; isa <= maxIsa; isa++) {
+    // all lengths up to a few vectors, to cover all tail handling
+    for (uint64_t samples = 0; samples <= maxSamples; samples++) {
+      utils::decodePcmSamplesScalar(encoded.data(), reference.data(), samples,
+                                    bits);
+      std::fill(decoded.begin(), decoded.end(), T{2});
+      const uint64_t done =
+          simd::decodePcmSamples(encoded.data(), decoded.data(), samples,
+                                 bits, static_cast<simd::Isa>(isa));
+      REQUIRE(done <= samples);
+      utils::decodePcmSamplesScalar(encoded.data() + done * (bits / 8),
+                                    decoded.data() + done, samples - done,
+                                    bits);
+      REQUIRE(std::memcmp(reference.data(), decoded.data(),
+                          samples * sizeof(T)) == 0);
+    }
+  }
+}
+
+TEST_CASE("decode_pcm_samples_simd") {
+  std::mt19937 engine(42);
+  std::uniform_int_distribution<int> dist(0, 255);
+  std::vector<char> encoded(4 * 70);
+  for (auto& byte : encoded) byte = static_cast<char>(dist(engine));
+  // include the extreme values
+  const char* extremes =
+      "\x00\x00\x00\x80"
+      "\xff\xff\xff\x7f"
+      "\xff\xff\xff\xff";
+  std::copy(extremes, extremes + 12, encoded.begin());
+
+  for (uint16_t bits : {16, 24, 32}) {
+    checkSimdDecode<float>(encoded, bits);
+    checkSimdDecode<double>(encoded, bits);
+  }
+}
+
+TEST_CASE("decode_pcm_samples_planar") {
+  const uint16_t channels = 5;
+  const uint64_t frames = 2000;
+  std::vector<char> encoded(frames * channels * 4);
+  for (size_t i = 0; i < encoded.size(); i++)
+    encoded[i] = static_cast<char>(i * 7);
+
+  for (uint16_t bits : {16, 24, 32}) {
+    std::vector<double> interleaved(frames * channels);
+    utils::decodePcmSamples(encoded.data(), interleaved.data(),
+                            frames * channels, bits);
+
+    // write to an offset, and check that nothing else is written
+    const uint64_t offset = 3;
+    std::vector<std::vector<double>> planar(
+        channels, std::vector<double>(offset + frames + 1, 2.0));
+    std::vector<double*> outBuffers;
+    for (auto& buffer : planar) outBuffers.push_back(buffer.data());
+    utils::decodePcmSamplesPlanar(encoded.data(), outBuffers.data(), offset,
+                                  frames, channels, bits);
+
+    for (uint16_t channel = 0; channel < channels; channel++) {
+      REQUIRE(planar[channel][offset - 1] == 2.0);
+      REQUIRE(planar[channel][offset + frames] == 2.0);
+      for (uint64_t frame = 0; frame < frames; frame++)
+        REQUIRE(planar[channel][offset + frame] ==
+                interleaved[frame * channels + channel]);
+    }
+  }
+
+  double* outBuffer = nullptr;
+  REQUIRE_THROWS_AS(
+      utils::decodePcmSamplesPlanar(encoded.data(), &outBuffer, 0, 1, 1, 8),
+      std::runtime_error);
+}
+
+TEST_CASE("decode_pcm_channels") {
+  const uint16_t channels = 5;
+  const uint64_t frames = 100;
+  std::vector<char> encoded(frames * channels * 4);
+  for (size_t i = 0; i < encoded.size(); i++)
+    encoded[i] = static_cast<char>(i * 7);
+  const uint16_t selected[] = {4, 0, 2};
+
+  for (uint16_t bits : {16, 24, 32}) {
+    std::vector<float> interleaved(frames * channels);
+    utils::decodePcmSamples(encoded.data(), interleaved.data(),
+                            frames * channels, bits);
+    std::vector<float> decoded(frames * 3);
+    utils::decodePcmChannels(encoded.data(), decoded.data(), frames, channels,
+                             selected, 3, bits);
+    for (uint64_t frame = 0; frame < frames; frame++)
+      for (size_t i = 0; i < 3; i++)
+        REQUIRE(decoded[frame * 3 + i] ==
+                interleaved[frame * channels + selected[i]]);
+  }
+}
+
+TEST_CASE("decode_pcm_samples_bench", "[.bench]") {
+  const size_t samples = 1000000;
+  std::vector<char> encoded(samples * 3);
+  for (size_t i = 0; i < encoded.size(); i++)
+    encoded[i] = static_cast<char>(i * 7);
+  std::vector<float> decoded(samples);
+
+  BENCHMARK("24 bit scalar") {
+    utils::decodePcmSamplesScalar(encoded.data(), decoded.data(), samples, 24);
+    return decoded[0];
+  };
+
+  BENCHMARK("24 bit") {
+    utils::decodePcmSamples(encoded.data(), decoded.data(), samples, 24);
+    return decoded[0];
+  };
+}
+
 TEST_CASE("encode_pcm_samples_8bit") {
   const float samples[] = {0.f, 1.f, -1.f, 0.5f, -0.5f};
   char encoded8bit[5];
@@ -136,6 +315,159 @@ TEST_CASE("encode_pcm_samples_32bit") {
   }
 }
 
+TEST_CASE("encode_pcm_samples_int") {
+  const int32_t samples[] = {0, INT32_MAX, INT32_MIN, 0x123456, -0x123456};
+
+  char encoded24bit[15];
+  utils::encodePcmSamples(samples, encoded24bit, 5, 24);
+  REQUIRE(std::string(encoded24bit, 15) ==
+          std::string("\x00\x00\x00"
+                      "\xff\xff\x7f"
+                      "\x00\x00\x80"
+                      "\x34\x12\x00"
+                      "\xcb\xed\xff",
+                      15));
+
+  const int32_t rightSamples[] = {0x123456, -0x123456};
+  utils::encodePcmSamples(rightSamples, encoded24bit, 2, 24,
+                          Justification::right);
+  REQUIRE(std::string(encoded24bit, 6) ==
+          std::string("\x56\x34\x12\xaa\xcb\xed", 6));
+
+  // int16 to 32 bit files shifts up
+  const int16_t shortSamples[] = {0x1234, INT16_MIN};
+  char encoded32bit[8];
+  utils::encodePcmSamples(shortSamples, encoded32bit, 2, 32);
+  REQUIRE(std::string(encoded32bit, 8) ==
+          std::string("\x00\x00\x34\x12\x00\x00\x00\x80", 8));
+
+  REQUIRE_THROWS_AS(utils::encodePcmSamples(shortSamples, encoded32bit, 2, 32,
+                                            Justification::right),
+                    std::runtime_error);
+}
+
+TEST_CASE("encode_decode_pcm_samples_int") {
+  for (uint16_t bits : {16, 24, 32}) {
+    const int32_t samples[] = {0, INT32_MAX, INT32_MIN, 0x12345678,
+                               -0x12345678};
+    char encoded[20];
+    int32_t decoded[5];
+    utils::encodePcmSamples(samples, encoded, 5, bits);
+    utils::decodePcmSamples(encoded, decoded, 5, bits);
+    const int shift = 32 - bits;
+    for (size_t i = 0; i < 5; i++)
+      REQUIRE(decoded[i] == utils::shiftSample(samples[i] >> shift, shift));
+  }
+}
+
+template <typename T>
+void checkSimdEncode(const std::vector<T>& samples, uint16_t bits) {
+  const size_t bytes = samples.size() * (bits / 8);
+  std::vector<char> reference(bytes);
+  std::vector<char> encoded(bytes);
+  const int maxIsa = static_cast<int>(simd::activeIsa());
+  for (int isa = 0; isa <= maxIsa; isa++) {
+    for (uint64_t n = 0; n <= samples.size(); n++) {
+      utils::encodePcmSamplesScalar(samples.data(), reference.data(), n, bits);
+      std::fill(encoded.begin(), encoded.end(), 'x');
+      const uint64_t done =
+          simd::encodePcmSamples(samples.data(), encoded.data(), n, bits,
+                                 static_cast<simd::Isa>(isa));
+      REQUIRE(done <= n);
+      utils::encodePcmSamplesScalar(samples.data() + done,
+                                    encoded.data() + done * (bits / 8),
+                                    n - done, bits);
+      REQUIRE(std::memcmp(reference.data(), encoded.data(), n * (bits / 8)) ==
+              0);
+      // nothing is written past the end
+      REQUIRE(std::count(encoded.begin() + n * (bits / 8), encoded.end(),
+                         'x') == static_cast<long>(bytes - n * (bits / 8)));
+    }
+  }
+}
+
+template <typename T>
+void checkSimdEncode(uint16_t bits) {
+  std::mt19937 engine(42);
+  std::uniform_real_distribution<T> dist(-1.5, 1.5);
+  std::vector<T> samples(70);
+  for (auto& sample : samples) sample = dist(engine);
+  // include clipping and values exactly between two integers, which test
+  // the rounding mode
+  const T scale = static_cast<T>(1u << (bits - 1));
+  const T extremes[] = {T{0},
+                        T{1},
+                        T{-1},
+                        std::numeric_limits<T>::infinity(),
+                        -std::numeric_limits<T>::infinity(),
+                        T{0.5} / scale,
+                        T{1.5} / scale,
+                        T{-2.5} / scale,
+                        T{1000.5} / scale};
+  std::copy(std::begin(extremes), std::end(extremes), samples.begin());
+  checkSimdEncode(samples, bits);
+}
+
+TEST_CASE("encode_pcm_samples_simd") {
+  for (uint16_t bits : {16, 24, 32}) {
+    checkSimdEncode<float>(bits);
+    checkSimdEncode<double>(bits);
+  }
+}
+
+TEST_CASE("encode_pcm_samples_bench", "[.bench]") {
+  const size_t samples = 1000000;
+  std::vector<float> decoded(samples);
+  for (size_t i = 0; i < samples; i++)
+    decoded[i] = static_cast<float>(i % 2000) / 1000.f - 1.f;
+  std::vector<char> encoded(samples * 3);
+
+  BENCHMARK("24 bit scalar") {
+    utils::encodePcmSamplesScalar(decoded.data(), encoded.data(), samples, 24);
+    return encoded[0];
+  };
+
+  BENCHMARK("24 bit") {
+    utils::encodePcmSamples(decoded.data(), encoded.data(), samples, 24);
+    return encoded[0];
+  };
+}
+
+TEST_CASE("encode_pcm_samples_planar") {
+  const uint16_t channels = 5;
+  const uint64_t frames = 2000;
+  std::vector<float> interleaved(frames * channels);
+  for (size_t i = 0; i < interleaved.size(); i++)
+    interleaved[i] = static_cast<float>(i % 301) / 150.f - 1.f;
+
+  // read from an offset
+  const uint64_t offset = 3;
+  std::vector<std::vector<float>> planar(channels,
+                                         std::vector<float>(offset + frames));
+  for (uint64_t frame = 0; frame < frames; frame++)
+    for (uint16_t channel = 0; channel < channels; channel++)
+      planar[channel][offset + frame] = interleaved[frame * channels + channel];
+  std::vector<const float*> inBuffers;
+  for (auto& buffer : planar) inBuffers.push_back(buffer.data());
+
+  for (uint16_t bits : {16, 24, 32}) {
+    const size_t bytes = frames * channels * (bits / 8);
+    std::vector<char> reference(bytes);
+    utils::encodePcmSamples(interleaved.data(), reference.data(),
+                            frames * channels, bits);
+    std::vector<char> encoded(bytes + 1, 'x');
+    utils::encodePcmSamplesPlanar(inBuffers.data(), offset, encoded.data(),
+                                  frames, channels, bits);
+    REQUIRE(std::memcmp(reference.data(), encoded.data(), bytes) == 0);
+    REQUIRE(encoded[bytes] == 'x');
+  }
+
+  char encoded8bit[1];
+  REQUIRE_THROWS_AS(utils::encodePcmSamplesPlanar(inBuffers.data(), 0,
+                                                  encoded8bit, 1, 1, 8),
+                    std::runtime_error);
+}
+
 TEST_CASE("encode_decode_pcm_samples_16bit") {
   char encoded16bit[10];
   const float samples[] = {0.f, 1.f, -1.f, 0.5f, -0.5f};
@@ -227,6 +559,164 @@ TEST_CASE("decode_encode_passthrough") {
   SECTION("32 bit double") { checkDecodeEncodeAroundEdges<4, double>(1000); }
 }
 
+TEST_CASE("read_ahead_buffer") {
+  // frames of 2 bytes, containing the low bits of the frame index
+  const uint64_t totalFrames = 1000;
+  std::atomic<bool> fail{false};
+  auto read = [&fail](uint64_t frameOffset, char* buffer, uint64_t frames) {
+    if (fail) throw std::runtime_error("read failed");
+    for (uint64_t i = 0; i < frames; i++) {
+      buffer[2 * i] = static_cast<char>(frameOffset + i);
+      buffer[2 * i + 1] = static_cast<char>((frameOffset + i) >> 8);
+    }
+  };
+  auto check = [](const std::vector<char>& buffer, uint64_t frameOffset,
+                  uint64_t frames) {
+    for (uint64_t i = 0; i < frames; i++) {
+      REQUIRE(buffer[2 * i] == static_cast<char>(frameOffset + i));
+      REQUIRE(buffer[2 * i + 1] == static_cast<char>((frameOffset + i) >> 8));
+    }
+  };
+
+  utils::ReadAheadBuffer readAhead(read, totalFrames, 2, 3, 64, 10);
+  std::vector<char> buffer(2 * totalFrames);
+
+  // sequential reads of sizes which don't match the blocks, up to the end
+  uint64_t position = 10;
+  for (uint64_t frames : {1, 63, 100, 200, 7}) {
+    readAhead.read(position, buffer.data(), frames);
+    check(buffer, position, frames);
+    position += frames;
+  }
+  readAhead.read(position, buffer.data(), totalFrames - position);
+  check(buffer, position, totalFrames - position);
+
+  // jumps restart reading
+  readAhead.read(500, buffer.data(), 10);
+  check(buffer, 500, 10);
+  readAhead.read(5, buffer.data(), 100);
+  check(buffer, 5, 100);
+
+  REQUIRE_THROWS_AS(readAhead.read(990, buffer.data(), 11),
+                    std::runtime_error);
+
+  // errors are passed to the reader, which can try again
+  fail = true;
+  REQUIRE_THROWS_AS(readAhead.read(0, buffer.data(), 10), std::runtime_error);
+  fail = false;
+  readAhead.read(0, buffer.data(), 10);
+  check(buffer, 0, 10);
+}
+
+TEST_CASE("file_direct_fallback") {
+  std::vector<char> data(10000);
+  for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<char>(i);
+  {
+    std::ofstream stream("file_direct_fallback.dat", std::ios::binary);
+    stream.write(data.data(), data.size());
+  }
+
+  // unaligned reads and writes are rejected with EINVAL by direct files, as
+  // some file systems do for all direct I/O; these still work, but turn off
+  // direct I/O
+  utils::File file("file_direct_fallback.dat", utils::FileAccess::read, true);
+  std::vector<char> buffer(100);
+  REQUIRE(file.readAt(buffer.data() + 1, 51, 3) == 51);
+  REQUIRE(std::equal(buffer.begin() + 1, buffer.begin() + 52,
+                     data.begin() + 3));
+  REQUIRE_FALSE(file.isDirect());
+
+  utils::File writeFile("file_direct_fallback.dat", utils::FileAccess::write,
+                        true);
+  writeFile.writeAt(buffer.data() + 1, 51, 5);
+  REQUIRE_FALSE(writeFile.isDirect());
+  REQUIRE(file.readAt(buffer.data(), 51, 5) == 51);
+  REQUIRE(std::equal(buffer.begin(), buffer.begin() + 51, data.begin() + 3));
+}
+
+TEST_CASE("ring_buffer") {
+  utils::RingBuffer<int> ring(10);
+  REQUIRE(ring.capacity() == 10);
+  REQUIRE(ring.readAvailable() == 0);
+  REQUIRE(ring.writeAvailable() == 10);
+
+  // writes and reads are limited by the space and values available, and
+  // wrap around the end of the buffer
+  std::vector<int> in{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+  std::vector<int> out(15);
+  REQUIRE(ring.write(in.data(), 7) == 7);
+  REQUIRE(ring.read(out.data(), 5) == 5);
+  REQUIRE(ring.write(in.data() + 7, 5) == 5);
+  REQUIRE(ring.writeAvailable() == 3);
+  REQUIRE(ring.write(in.data(), 12) == 3);
+  REQUIRE(ring.readAvailable() == 10);
+  REQUIRE(ring.read(out.data() + 5, 10) == 10);
+  // all of in, then the first 3 values written when nearly full
+  std::vector<int> expectedOut(in);
+  expectedOut.insert(expectedOut.end(), in.begin(), in.begin() + 3);
+  REQUIRE(out == expectedOut);
+
+  REQUIRE(ring.write(in.data(), 4) == 4);
+  REQUIRE(ring.discard() == 4);
+  REQUIRE(ring.readAvailable() == 0);
+
+  // one producer and one consumer thread
+  const int total = 100000;
+  utils::RingBuffer<int> threadRing(64);
+  std::thread producer([&threadRing]() {
+    int next = 0;
+    while (next < total) {
+      int block[7];
+      const int count = (std::min)(7, total - next);
+      for (int i = 0; i < count; i++) block[i] = next + i;
+      next += static_cast<int>(threadRing.write(block, count));
+    }
+  });
+  int expected = 0;
+  bool ordered = true;
+  while (expected < total) {
+    int block[5];
+    const size_t count = threadRing.read(block, 5);
+    for (size_t i = 0; i < count; i++) ordered &= block[i] == expected++;
+  }
+  producer.join();
+  REQUIRE(ordered);
+}
+
+#ifdef BW64_IO_URING
+TEST_CASE("io_uring") {
+  utils::IoUring ring(4, 1000);
+  // io_uring may not be supported by the kernel
+  if (!ring.isOpen()) return;
+
+  std::vector<char> data(10500);
+  for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<char>(i * 7);
+  // File only opens existing files for writing
+  std::ofstream("io_uring.dat", std::ios::binary).close();
+
+  {
+    utils::File file("io_uring.dat", utils::FileAccess::write);
+    ring.writeAt(file.fd(), data.data(), data.size(), 0);
+  }
+
+  utils::File file("io_uring.dat");
+  std::vector<char> readData(data.size() + 100);
+  // unregistered, and registered
+  for (int i = 0; i < 2; i++) {
+    if (i == 1) ring.useBuffer(readData.data(), readData.size());
+    std::fill(readData.begin(), readData.end(), 0);
+    REQUIRE(ring.readAt(file.fd(), readData.data(), 2000, 10) == 2000);
+    REQUIRE(std::equal(readData.begin(), readData.begin() + 2000,
+                       data.begin() + 10));
+    // reads stop at the end of the file
+    REQUIRE(ring.readAt(file.fd(), readData.data(), readData.size(), 0) ==
+            data.size());
+    REQUIRE(std::equal(data.begin(), data.end(), readData.begin()));
+  }
+  ring.unregisterBuffer();
+}
+#endif
+
 TEST_CASE("write_chunk_with_padding") {
   auto axmlChunk = std::make_shared<AxmlChunk>("123456789");
   std::ostringstream stream;